@@ -0,0 +1,201 @@
+/*
+ * aesd-atomic-ring.h
+ *
+ *  @brief Lock-free fixed capacity rings for passing elements between user space threads,
+ *  generated for an element type and power of 2 capacity like the rings in aesd-ring.h.
+ *
+ *  AESD_SPSC_RING_DEFINE(name, type, capacity) is for one producer and one consumer thread.
+ *  AESD_MPSC_RING_DEFINE(name, type, capacity) allows any number of producer threads and one
+ *  consumer thread.  Both define struct name and:
+ *      void name_init(struct name *ring)
+ *      bool name_push(struct name *ring, const type *item)
+ *      size_t name_push_batch(struct name *ring, const type *items, size_t count)
+ *      bool name_pop(struct name *ring, type *item)
+ *      size_t name_pop_batch(struct name *ring, type *items, size_t count)
+ *
+ *  Unlike aesd-ring.h a full ring is never overwritten, push returns false (or a short batch
+ *  count) instead.  Producer and consumer indexes are free-running counters on separate
+ *  cache lines, so the two sides only share a line when one has to refresh its view of the
+ *  other.  The batch versions publish all their elements with a single atomic store.
+ *
+ *  The structures are aligned to AESD_CACHELINE_SIZE, which malloc() doesn't guarantee.
+ *  Place them in static storage, on the stack or in another aligned structure, or allocate
+ *  them with aligned_alloc(AESD_CACHELINE_SIZE, sizeof(struct name)).
+ */
+
+#ifndef AESD_ATOMIC_RING_H
+#define AESD_ATOMIC_RING_H
+
+#ifdef __KERNEL__
+#error "aesd-atomic-ring.h uses C11 atomics and is for user space only"
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifndef AESD_CACHELINE_SIZE
+#define AESD_CACHELINE_SIZE 64
+#endif
+
+#define AESD_ATOMIC_RING_CHECK_CAPACITY(name, capacity) \
+    _Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0, \
+            #name " capacity must be a power of 2")
+
+/**
+ * Single producer, single consumer.  Each side caches the other's index and only reloads it,
+ * taking the cache miss, when the cached value says the ring is full or empty.
+ */
+#define AESD_SPSC_RING_DEFINE(name, type, capacity) \
+struct name \
+{ \
+    _Alignas(AESD_CACHELINE_SIZE) atomic_size_t head;  /* Next element to pop, written by the consumer */ \
+    size_t tail_cache;                                  /* Consumer's copy of tail */ \
+    _Alignas(AESD_CACHELINE_SIZE) atomic_size_t tail;  /* Next slot to push, written by the producer */ \
+    size_t head_cache;                                  /* Producer's copy of head */ \
+    _Alignas(AESD_CACHELINE_SIZE) type entry[capacity]; \
+}; \
+\
+static inline void name##_init(struct name *ring) \
+{ \
+    atomic_init(&ring->head, 0); \
+    atomic_init(&ring->tail, 0); \
+    ring->tail_cache = 0; \
+    ring->head_cache = 0; \
+} \
+\
+/* Producer only.  @return the number of elements of @param items pushed, 0 if full */ \
+static inline size_t name##_push_batch(struct name *ring, const type *items, size_t count) \
+{ \
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed); \
+    size_t space = (capacity) - (tail - ring->head_cache); \
+    size_t i; \
+\
+    if (space < count) { \
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire); \
+        space = (capacity) - (tail - ring->head_cache); \
+        if (count > space) \
+            count = space; \
+    } \
+    for (i = 0; i < count; i++) \
+        ring->entry[(tail + i) & ((capacity) - 1)] = items[i]; \
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release); \
+    return count; \
+} \
+\
+/* Consumer only.  @return the number of elements copied to @param items, 0 if empty */ \
+static inline size_t name##_pop_batch(struct name *ring, type *items, size_t count) \
+{ \
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed); \
+    size_t available = ring->tail_cache - head; \
+    size_t i; \
+\
+    if (available < count) { \
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire); \
+        available = ring->tail_cache - head; \
+        if (count > available) \
+            count = available; \
+    } \
+    for (i = 0; i < count; i++) \
+        items[i] = ring->entry[(head + i) & ((capacity) - 1)]; \
+    atomic_store_explicit(&ring->head, head + count, memory_order_release); \
+    return count; \
+} \
+\
+static inline bool name##_push(struct name *ring, const type *item) \
+{ \
+    return name##_push_batch(ring, item, 1) == 1; \
+} \
+\
+static inline bool name##_pop(struct name *ring, type *item) \
+{ \
+    return name##_pop_batch(ring, item, 1) == 1; \
+} \
+\
+AESD_ATOMIC_RING_CHECK_CAPACITY(name, capacity)
+
+/**
+ * Multiple producers, single consumer.  Producers claim slots by advancing tail with a
+ * compare and swap, then mark each slot written through its sequence number, so the consumer
+ * never reads a slot a slower producer claimed but hasn't filled yet.
+ */
+#define AESD_MPSC_RING_DEFINE(name, type, capacity) \
+struct name##_cell \
+{ \
+    atomic_size_t seq;  /* Position + 1 once the element for that position is written */ \
+    type data; \
+}; \
+\
+struct name \
+{ \
+    _Alignas(AESD_CACHELINE_SIZE) atomic_size_t head;  /* Next element to pop, written by the consumer */ \
+    _Alignas(AESD_CACHELINE_SIZE) atomic_size_t tail;  /* Next slot to claim, shared by producers */ \
+    _Alignas(AESD_CACHELINE_SIZE) struct name##_cell cell[capacity]; \
+}; \
+\
+static inline void name##_init(struct name *ring) \
+{ \
+    size_t i; \
+\
+    atomic_init(&ring->head, 0); \
+    atomic_init(&ring->tail, 0); \
+    for (i = 0; i < (capacity); i++) \
+        atomic_init(&ring->cell[i].seq, 0); \
+} \
+\
+/* Any thread.  @return the number of elements of @param items pushed, 0 if full */ \
+static inline size_t name##_push_batch(struct name *ring, const type *items, size_t count) \
+{ \
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed); \
+    size_t space; \
+    size_t i; \
+\
+    do { \
+        space = (capacity) - (tail - atomic_load_explicit(&ring->head, memory_order_acquire)); \
+        if (space == 0) \
+            return 0; \
+        if (count > space) \
+            count = space; \
+    } while (!atomic_compare_exchange_weak_explicit(&ring->tail, &tail, tail + count, \
+            memory_order_relaxed, memory_order_relaxed)); \
+\
+    for (i = 0; i < count; i++) { \
+        struct name##_cell *cell = &ring->cell[(tail + i) & ((capacity) - 1)]; \
+\
+        cell->data = items[i]; \
+        atomic_store_explicit(&cell->seq, tail + i + 1, memory_order_release); \
+    } \
+    return count; \
+} \
+\
+/* Consumer only.  @return the number of elements copied to @param items, 0 if empty */ \
+static inline size_t name##_pop_batch(struct name *ring, type *items, size_t count) \
+{ \
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed); \
+    size_t i; \
+\
+    for (i = 0; i < count; i++) { \
+        struct name##_cell *cell = &ring->cell[(head + i) & ((capacity) - 1)]; \
+\
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != head + i + 1) \
+            break; \
+        items[i] = cell->data; \
+    } \
+    if (i) \
+        atomic_store_explicit(&ring->head, head + i, memory_order_release); \
+    return i; \
+} \
+\
+static inline bool name##_push(struct name *ring, const type *item) \
+{ \
+    return name##_push_batch(ring, item, 1) == 1; \
+} \
+\
+static inline bool name##_pop(struct name *ring, type *item) \
+{ \
+    return name##_pop_batch(ring, item, 1) == 1; \
+} \
+\
+AESD_ATOMIC_RING_CHECK_CAPACITY(name, capacity)
+
+#endif /* AESD_ATOMIC_RING_H */
@@ -34,15 +34,14 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
     */
 
     size_t total_offset = 0;
-    uint8_t index = buffer->out_offs;
+    struct aesd_buffer_entry *current_entry;
+    unsigned int index;
 
     if (buffer == NULL || entry_offset_byte_rtn == NULL)
         return NULL;
 
-    // Iterate through the buffer entries starting at the out_offs
-    do {
-        struct aesd_buffer_entry *current_entry = &buffer->entry[index];
-
+    // Iterate through the stored entries from oldest to newest
+    for (index = 0; (current_entry = aesd_entry_ring_at(buffer, index)) != NULL; index++) {
         // If the current entry contains the char_offset
         if (char_offset < total_offset + current_entry->size) {
             *entry_offset_byte_rtn = char_offset - total_offset;
@@ -51,14 +50,7 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
 
         // Move to the next entry
         total_offset += current_entry->size;
-        index = (index + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-
-        // If we wrapped around and hit in_offs, stop
-        if (!buffer->full && index == buffer->in_offs) {
-            break;
-        }
-
-    } while (index != buffer->out_offs);
+    }
 
     // If the offset was not found, return NULL
     return NULL;
@@ -77,25 +69,79 @@ void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const s
     * TODO: implement per description
     */
 
+    aesd_circular_buffer_add_entry_evict(buffer, add_entry, NULL);
+}
+
+/**
+* Adds entry @param add_entry to @param buffer as aesd_circular_buffer_add_entry() does.
+* Any necessary locking must be handled by the caller.
+* @param evicted_entry if not NULL, set to the oldest entry when it is overwritten, so the caller
+*   can free the memory it references
+* @return true if the buffer was full and the oldest entry was overwritten
+*/
+bool aesd_circular_buffer_add_entry_evict(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry, struct aesd_buffer_entry *evicted_entry)
+{
+    struct aesd_buffer_entry overwritten;
+
     if (buffer == NULL || add_entry == NULL)
-        return;
+        return false;
 
-    // Add the entry at the current in_offs position
-    buffer->entry[buffer->in_offs] = *add_entry;
+    buffer->total_size += add_entry->size;
 
-    // Check if the buffer is full
-    if (buffer->full) {
-        // If full, advance the out_offs to the next position (overwrite the oldest entry)
-        buffer->out_offs = (buffer->out_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
-    }
+    // If full, the oldest entry is overwritten and out_offs advances to the new start location
+    if (!aesd_entry_ring_push(buffer, add_entry, &overwritten))
+        return false;
 
-    // Advance the in_offs to the next position
-    buffer->in_offs = (buffer->in_offs + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    buffer->total_size -= overwritten.size;
+    if (evicted_entry)
+        *evicted_entry = overwritten;
+    return true;
+}
 
-    // If in_offs catches up with out_offs, the buffer is now full
-    if (buffer->in_offs == buffer->out_offs) {
-        buffer->full = true;
-    }
+/**
+* @param buffer the buffer about to receive an entry.  Any necessary locking must be performed by caller.
+* @param add_size the size in bytes of the entry about to be added
+* @return true if the oldest entry must be removed with aesd_circular_buffer_remove_oldest() before
+*   adding the entry, to keep the stored bytes within buffer->max_bytes and the number of entries
+*   below buffer->max_entries.  The newest entry is always kept, even when it alone exceeds max_bytes.
+*   Call repeatedly until it returns false, which costs O(1) per removed entry.
+*/
+bool aesd_circular_buffer_needs_eviction(const struct aesd_circular_buffer *buffer, size_t add_size)
+{
+    uint8_t count;
+
+    if (buffer == NULL)
+        return false;
+
+    count = aesd_circular_buffer_count(buffer);
+    if (count == 0)
+        return false;
+
+    if (buffer->max_entries && count >= buffer->max_entries)
+        return true;
+
+    return buffer->max_bytes && buffer->total_size + add_size > buffer->max_bytes;
+}
+
+/**
+* Removes the oldest entry from @param buffer and advances buffer->out_offs.
+* Any necessary locking must be handled by the caller.
+* @param removed_entry set to the removed entry, so the caller can free the memory it references
+* @return true if an entry was removed, false if the buffer was empty
+*/
+bool aesd_circular_buffer_remove_oldest(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *removed_entry)
+{
+    if (buffer == NULL || removed_entry == NULL)
+        return false;
+
+    // The slot is cleared so searches and AESD_CIRCULAR_BUFFER_FOREACH don't see the removed entry
+    if (!aesd_entry_ring_pop(buffer, removed_entry))
+        return false;
+
+    buffer->total_size -= removed_entry->size;
+    return true;
 }
 
 /**
@@ -105,3 +151,58 @@ void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
 {
     memset(buffer,0,sizeof(struct aesd_circular_buffer));
 }
+
+/**
+* Describes the stored data from @param char_offset onwards as a scatter list, oldest entry first,
+* so it can be passed whole to writev() or copied with copy_to_iter().
+* Any necessary locking must be handled by the caller, and the entries must stay allocated while
+* @param vec is used.
+* @param char_offset the position to start at, as for aesd_circular_buffer_find_entry_offset_for_fpos()
+* @param max_bytes the most bytes to describe, the last element is shortened to fit.  0 for no limit.
+* @param vec the array to fill, the first element starts part way into its entry for a nonzero offset
+* @param max_vecs the number of elements in @param vec, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED is
+*   always enough
+* @param entry_offset_byte_rtn if not NULL, set to the byte of its entry at which the first element
+*   starts, so the caller can find the entry's buffptr.  Only set when an element is filled.
+* @return the number of elements of @param vec filled, 0 if no data follows @param char_offset
+*/
+unsigned int aesd_circular_buffer_export_iovec(struct aesd_circular_buffer *buffer,
+            size_t char_offset, size_t max_bytes, aesd_iovec_t *vec, unsigned int max_vecs,
+            size_t *entry_offset_byte_rtn)
+{
+    struct aesd_buffer_entry *entry;
+    unsigned int nr_vecs = 0;
+    uint8_t index;
+
+    if (buffer == NULL || vec == NULL)
+        return 0;
+
+    AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry, buffer, index) {
+        if (nr_vecs == max_vecs)
+            break;
+
+        // Skip whole entries before the offset
+        if (char_offset >= entry->size) {
+            char_offset -= entry->size;
+            continue;
+        }
+
+        if (nr_vecs == 0 && entry_offset_byte_rtn)
+            *entry_offset_byte_rtn = char_offset;
+
+        vec[nr_vecs].iov_base = (char *)entry->buffptr + char_offset;
+        vec[nr_vecs].iov_len = entry->size - char_offset;
+        char_offset = 0;
+        nr_vecs++;
+
+        if (max_bytes) {
+            if (vec[nr_vecs - 1].iov_len >= max_bytes) {
+                vec[nr_vecs - 1].iov_len = max_bytes;
+                break;
+            }
+            max_bytes -= vec[nr_vecs - 1].iov_len;
+        }
+    }
+
+    return nr_vecs;
+}
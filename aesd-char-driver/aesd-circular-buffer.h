@@ -10,14 +10,25 @@
 
 #ifdef __KERNEL__
 #include <linux/types.h>
+#include <linux/uio.h> // struct kvec
 #else
 #include <stddef.h> // size_t
 #include <stdint.h> // uintx_t
 #include <stdbool.h>
+#include <sys/uio.h> // struct iovec
 #endif
 
+#include "aesd-ring.h"
+
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
 
+/* The scatter list filled by aesd_circular_buffer_export_iovec(), both have iov_base and iov_len */
+#ifdef __KERNEL__
+typedef struct kvec aesd_iovec_t;
+#else
+typedef struct iovec aesd_iovec_t;
+#endif
+
 struct aesd_buffer_entry
 {
     /**
@@ -28,6 +39,11 @@ struct aesd_buffer_entry
      * Number of bytes stored in buffptr
      */
     size_t size;
+    /**
+     * Time the entry was added, in nanoseconds.  The aesdchar driver records CLOCK_MONOTONIC
+     * (ktime_get_ns) at commit, so entries are in non-decreasing time order.
+     */
+    uint64_t timestamp_ns;
 };
 
 struct aesd_circular_buffer
@@ -49,6 +65,18 @@ struct aesd_circular_buffer
      * set to true when the buffer entry structure is full
      */
     bool full;
+    /**
+     * Total number of bytes in the stored entries, maintained on every add and remove
+     */
+    size_t total_size;
+    /**
+     * Retention budget in bytes, 0 for no limit.  See aesd_circular_buffer_needs_eviction()
+     */
+    size_t max_bytes;
+    /**
+     * Maximum number of stored entries, 0 to use every entry in the structure
+     */
+    uint8_t max_entries;
 };
 
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
@@ -56,8 +84,36 @@ extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos
 
 extern void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
 
+extern bool aesd_circular_buffer_add_entry_evict(struct aesd_circular_buffer *buffer,
+            const struct aesd_buffer_entry *add_entry, struct aesd_buffer_entry *evicted_entry);
+
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
 
+extern bool aesd_circular_buffer_needs_eviction(const struct aesd_circular_buffer *buffer, size_t add_size);
+
+extern bool aesd_circular_buffer_remove_oldest(struct aesd_circular_buffer *buffer,
+            struct aesd_buffer_entry *removed_entry);
+
+extern unsigned int aesd_circular_buffer_export_iovec(struct aesd_circular_buffer *buffer,
+            size_t char_offset, size_t max_bytes, aesd_iovec_t *vec, unsigned int max_vecs,
+            size_t *entry_offset_byte_rtn);
+
+/*
+ * The ring operations behind the functions above, aesd_entry_ring_init(), _count(), _at(),
+ * _push() and _pop() on struct aesd_circular_buffer.  total_size isn't maintained by them.
+ */
+AESD_RING_DEFINE_OPS(aesd_entry_ring, struct aesd_circular_buffer, struct aesd_buffer_entry,
+        AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+
+/**
+ * @return the number of entries currently stored in @param buffer.  Any necessary locking
+ * must be performed by caller.
+ */
+static inline uint8_t aesd_circular_buffer_count(const struct aesd_circular_buffer *buffer)
+{
+    return aesd_entry_ring_count(buffer);
+}
+
 /**
  * Create a for loop to iterate over each member of the circular buffer.
  * Useful when you've allocated memory for circular buffer entries and need to free it
@@ -77,6 +133,20 @@ extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
             index<AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; \
             index++, entryptr=&((buffer)->entry[index]))
 
+/**
+ * Like AESD_CIRCULAR_BUFFER_FOREACH, but visits only the stored entries, oldest to newest.
+ * @param index counts the entries visited, 0 being the oldest
+ * Example usage:
+ * uint8_t index;
+ * struct aesd_buffer_entry *entry;
+ * size_t total = 0;
+ * AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry,&buffer,index) {
+ *      total += entry->size;
+ * }
+ */
+#define AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entryptr,buffer,index) \
+    for(index=0; ((entryptr)=aesd_entry_ring_at((buffer),index)) != NULL; index++)
+
 
 
 #endif /* AESD_CIRCULAR_BUFFER_H */
@@ -0,0 +1,130 @@
+/*
+ * aesd-ring.h
+ *
+ *  @brief Generic fixed capacity ring buffer, specialized at compile time for an element type
+ *  and capacity.  Usable from both the kernel and user space.  When the capacity is a power
+ *  of 2 the index arithmetic compiles to a mask.
+ *
+ *  AESD_RING_DEFINE(name, type, capacity) declares struct name and its functions:
+ *      void name_init(struct name *ring)
+ *      unsigned int name_count(const struct name *ring)
+ *      bool name_empty(const struct name *ring)
+ *      type *name_at(struct name *ring, unsigned int index)
+ *      bool name_push(struct name *ring, const type *item, type *overwritten)
+ *      bool name_pop(struct name *ring, type *item)
+ *
+ *  AESD_RING_DEFINE_OPS(prefix, ring_type, type, capacity) defines only the functions, for an
+ *  existing structure with the entry, in_offs, out_offs and full members of struct name.
+ *  Any necessary locking must be performed by the caller.
+ */
+
+#ifndef AESD_RING_H
+#define AESD_RING_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stddef.h> // size_t
+#include <stdint.h> // uintx_t
+#include <stdbool.h>
+#include <string.h>
+#endif
+
+/**
+ * @return @param index reduced modulo @param capacity, a mask when capacity is a power of 2
+ */
+#define AESD_RING_WRAP(index, capacity) \
+    ((((capacity) & ((capacity) - 1)) == 0) ? ((index) & ((capacity) - 1)) : ((index) % (capacity)))
+
+/**
+ * Declare struct @param name holding up to @param capacity elements of @param type
+ */
+#define AESD_RING_DECLARE(name, type, capacity) \
+struct name \
+{ \
+    type entry[capacity];   /* Element storage */ \
+    unsigned int in_offs;   /* Where the next element is stored */ \
+    unsigned int out_offs;  /* The oldest element */ \
+    bool full;              /* in_offs == out_offs means full rather than empty */ \
+}
+
+#define AESD_RING_DEFINE_OPS(prefix, ring_type, type, capacity) \
+/* Empty the ring, leaving any other members of ring_type alone */ \
+static inline void prefix##_init(ring_type *ring) \
+{ \
+    memset(ring->entry, 0, sizeof(ring->entry)); \
+    ring->in_offs = 0; \
+    ring->out_offs = 0; \
+    ring->full = false; \
+} \
+\
+/* @return the number of stored elements */ \
+static inline unsigned int prefix##_count(const ring_type *ring) \
+{ \
+    if (ring->full) \
+        return (capacity); \
+    return AESD_RING_WRAP(ring->in_offs + (capacity) - ring->out_offs, (capacity)); \
+} \
+\
+static inline bool prefix##_empty(const ring_type *ring) \
+{ \
+    return !ring->full && ring->in_offs == ring->out_offs; \
+} \
+\
+/* @return the element @param index places after the oldest, or NULL past the newest */ \
+static inline type *prefix##_at(ring_type *ring, unsigned int index) \
+{ \
+    if (index >= prefix##_count(ring)) \
+        return NULL; \
+    return &ring->entry[AESD_RING_WRAP(ring->out_offs + index, (capacity))]; \
+} \
+\
+/* \
+ * Append a copy of @param item, overwriting the oldest element when full. \
+ * @param overwritten if not NULL, set to the overwritten element \
+ * @return true if an element was overwritten \
+ */ \
+static inline bool prefix##_push(ring_type *ring, const type *item, type *overwritten) \
+{ \
+    bool was_full = ring->full; \
+\
+    if (was_full) { \
+        if (overwritten) \
+            *overwritten = ring->entry[ring->in_offs]; \
+        ring->out_offs = AESD_RING_WRAP(ring->out_offs + 1, (capacity)); \
+    } \
+    ring->entry[ring->in_offs] = *item; \
+    ring->in_offs = AESD_RING_WRAP(ring->in_offs + 1, (capacity)); \
+    ring->full = ring->in_offs == ring->out_offs; \
+    return was_full; \
+} \
+\
+/* \
+ * Remove the oldest element and clear its slot. \
+ * @param item if not NULL, set to the removed element \
+ * @return false if the ring was empty \
+ */ \
+static inline bool prefix##_pop(ring_type *ring, type *item) \
+{ \
+    if (prefix##_empty(ring)) \
+        return false; \
+    if (item) \
+        *item = ring->entry[ring->out_offs]; \
+    memset(&ring->entry[ring->out_offs], 0, sizeof(ring->entry[0])); \
+    ring->out_offs = AESD_RING_WRAP(ring->out_offs + 1, (capacity)); \
+    ring->full = false; \
+    return true; \
+} \
+\
+_Static_assert((capacity) > 0 && (capacity) - 1 <= (__typeof__(((ring_type *)0)->in_offs))~0u, \
+        #prefix " capacity doesn't fit its index type")
+
+/**
+ * Declare struct @param name and define its functions, see the top of this file
+ */
+#define AESD_RING_DEFINE(name, type, capacity) \
+    AESD_RING_DECLARE(name, type, capacity); \
+    AESD_RING_DEFINE_OPS(name, struct name, type, capacity)
+
+#endif /* AESD_RING_H */
@@ -24,7 +24,7 @@
  */
 struct aesd_seekto {
     /**
-     * The zero referenced write command to seek into
+     * The zero referenced write command to seek into, 0 being the oldest stored command
      */
     uint32_t write_cmd;
     /**
@@ -33,14 +33,194 @@ struct aesd_seekto {
     uint32_t write_cmd_offset;
 };
 
+/**
+ * Description of one stored command returned by AESDCHAR_IOCGETINDEX
+ */
+struct aesd_index_entry {
+    /**
+     * The zero referenced write command, as used with AESDCHAR_IOCSEEKTO
+     */
+    uint32_t write_cmd;
+    /**
+     * Number of bytes in the command
+     */
+    uint32_t size;
+    /**
+     * File position of the first byte of the command
+     */
+    uint64_t offset;
+    /**
+     * Sequence number of the command, counting every command committed since the module was
+     * loaded.  Unlike write_cmd it doesn't change when older commands are overwritten.
+     */
+    uint64_t seq;
+    /**
+     * CLOCK_MONOTONIC time in nanoseconds at which the command was committed
+     */
+    uint64_t timestamp_ns;
+};
+
+/**
+ * A structure to be passed by IOCTL from user space to kernel space, describing an array
+ * to fill with struct aesd_index_entry, oldest command first
+ */
+struct aesd_index {
+    /**
+     * On input the number of elements available in entries, on output the number of
+     * stored commands, which may be larger than the number copied
+     */
+    uint32_t count;
+    uint32_t reserved;
+    /**
+     * User space address of the struct aesd_index_entry array
+     */
+    uint64_t entries;
+};
+
+/**
+ * A structure to be passed by IOCTL from user space to kernel space, describing a read
+ * starting at a stored command which doesn't use or change the file position
+ */
+struct aesd_pread {
+    /**
+     * The zero referenced write command to read from
+     */
+    uint32_t write_cmd;
+    /**
+     * The zero referenced offset within the write
+     */
+    uint32_t write_cmd_offset;
+    /**
+     * User space address of the buffer to fill
+     */
+    uint64_t buf;
+    /**
+     * Size of the buffer in bytes.  The read continues across following commands until the
+     * buffer is full or the data runs out, the ioctl returns the number of bytes copied.
+     */
+    uint64_t len;
+};
+
+/**
+ * A structure to be passed by IOCTL between user space and kernel space, addressing a command
+ * by its sequence number.  Sequence numbers count every command committed since the module
+ * was loaded, so unlike write_cmd they stay valid when older commands are overwritten.
+ * Commands which were overwritten fail with errno ESTALE.
+ */
+struct aesd_seqread {
+    /**
+     * Sequence number of the command, advanced by AESDCHAR_IOCREADSEQ past the data copied
+     */
+    uint64_t seq;
+    /**
+     * User space address of the buffer to fill, used by AESDCHAR_IOCREADSEQ only
+     */
+    uint64_t buf;
+    /**
+     * Size of the buffer in bytes, used by AESDCHAR_IOCREADSEQ only
+     */
+    uint64_t len;
+    /**
+     * The zero referenced offset within the command, advanced with seq
+     */
+    uint32_t seq_offset;
+    uint32_t reserved;
+    /**
+     * Set to the sequence number of the oldest stored command, also on ESTALE
+     */
+    uint64_t first_seq;
+    /**
+     * Set to the sequence number the next written command will get
+     */
+    uint64_t next_seq;
+};
+
+/**
+ * A structure to be passed by IOCTL between user space and kernel space, to seek to the first
+ * command committed at or after a point in time
+ */
+struct aesd_seektime {
+    /**
+     * CLOCK_MONOTONIC time in nanoseconds, as from clock_gettime(CLOCK_MONOTONIC)
+     */
+    uint64_t timestamp_ns;
+    /**
+     * Set to the sequence number of the command found, for use with AESDCHAR_IOCREADSEQ.
+     * When every stored command is older this is the next sequence number.
+     */
+    uint64_t seq;
+    /**
+     * Set to the file position of the command found, the end of the data if none was found
+     */
+    uint64_t offset;
+    /**
+     * Set to the zero referenced write command found, the number of stored commands if none
+     */
+    uint32_t write_cmd;
+    uint32_t reserved;
+};
+
 // Pick an arbitrary unused value from https://github.com/torvalds/linux/blob/master/Documentation/userspace-api/ioctl/ioctl-number.rst
 #define AESD_IOC_MAGIC 0x16
 
 // Define a write command from the user point of view, use command number 1
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+// Fill a user array with the index of every stored command
+#define AESDCHAR_IOCGETINDEX _IOWR(AESD_IOC_MAGIC, 2, struct aesd_index)
+// Read from a command and offset without using the file position
+#define AESDCHAR_IOCPREAD _IOW(AESD_IOC_MAGIC, 3, struct aesd_pread)
+// Set the file position to a command given by sequence number
+#define AESDCHAR_IOCSEEKSEQ _IOWR(AESD_IOC_MAGIC, 4, struct aesd_seqread)
+// Read from a command given by sequence number without using the file position
+#define AESDCHAR_IOCREADSEQ _IOWR(AESD_IOC_MAGIC, 5, struct aesd_seqread)
+// Set the file position to the first command committed at or after a time
+#define AESDCHAR_IOCSEEKTIME _IOWR(AESD_IOC_MAGIC, 6, struct aesd_seektime)
 /**
  * The maximum number of commands supported, used for bounds checking
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 6
+
+/**
+ * Read-only mmap() of the command history.  The mapping starts with a struct aesd_mmap_header
+ * and the data area begins at AESD_MMAP_DATA_OFFSET, with one AESD_MMAP_SLOT_SIZE slot per
+ * circular buffer entry.  Map AESD_MMAP_SIZE bytes at offset 0 with PROT_READ.
+ */
+#define AESD_MMAP_MAX_ENTRIES 10
+#define AESD_MMAP_SLOT_SIZE 1024
+#define AESD_MMAP_DATA_OFFSET 4096
+#define AESD_MMAP_SIZE (AESD_MMAP_DATA_OFFSET + AESD_MMAP_MAX_ENTRIES * AESD_MMAP_SLOT_SIZE)
+
+/**
+ * Location of a single command in the mapping
+ */
+struct aesd_mmap_entry {
+    /**
+     * Byte offset of the command from the start of the mapping
+     */
+    uint32_t offset;
+    /**
+     * Number of bytes in the command
+     */
+    uint32_t size;
+};
+
+struct aesd_mmap_header {
+    /**
+     * Odd while the driver is updating the mapping.  Readers sample it before and after
+     * scanning and retry if it was odd or changed, as with a seqlock.
+     */
+    uint32_t generation;
+    /**
+     * Number of valid commands in entry[], oldest first
+     */
+    uint32_t count;
+    /**
+     * Total number of commands committed since the module was loaded.  A reader which saw
+     * total_commands T and count C earlier has missed commands when the new value exceeds
+     * T + the new count, because they were overwritten on wrap-around.
+     */
+    uint64_t total_commands;
+    struct aesd_mmap_entry entry[AESD_MMAP_MAX_ENTRIES];
+};
 
 #endif /* AESD_IOCTL_H */
@@ -7,13 +7,23 @@
 
 #include <linux/cdev.h>    // For struct cdev
 #include <linux/mutex.h>   // For struct mutex
+#include <linux/seqlock.h> // For seqcount_t
+#include <linux/refcount.h> // For refcount_t
+#include <linux/rcupdate.h> // For struct rcu_head
+#include <linux/wait.h>    // For wait_queue_head_t
+#include <linux/fs.h>      // For struct fasync_struct
+#include <linux/poll.h>    // For poll_table
+#include <linux/percpu.h>  // For per-CPU statistics
+#include <linux/debugfs.h> // For struct dentry
 #include "aesd-circular-buffer.h"  // Include the circular buffer header
+#include "aesd_ioctl.h"            // For struct aesd_mmap_header
 
 #ifndef AESD_CHAR_DRIVER_AESDCHAR_H_
 #define AESD_CHAR_DRIVER_AESDCHAR_H_
 #define AESDCHAR_MAX_WRITE_SIZE 1024
+#define AESD_NR_DEVS 4 // Default number of aesdchar minors, override with nr_devs
 
-#define AESD_DEBUG 1  //Remove comment on this line to enable debug
+//#define AESD_DEBUG 1  //Remove comment on this line to enable debug, or build with DEBUG=y
 
 #undef PDEBUG             /* undef it, just in case */
 #ifdef AESD_DEBUG
@@ -28,6 +38,34 @@
 #  define PDEBUG(fmt, args...) /* not debugging: nothing */
 #endif
 
+/**
+ * Allocation backing the buffptr of every circular buffer entry.  Readers take a reference
+ * under rcu_read_lock() so the data stays valid while they copy it to user space without
+ * holding dev->lock.  The last reference frees the allocation after an RCU grace period.
+ */
+struct aesd_buffer_data
+{
+    refcount_t refcount;
+    struct rcu_head rcu;
+    char data[];
+};
+
+/**
+ * Runtime statistics, kept per CPU so the fast paths never share a cache line.  Summed on
+ * demand for /sys/class/aesdchar/aesdcharN/stats and /sys/kernel/debug/aesdchar/aesdcharN/stats
+ */
+struct aesd_stats
+{
+    u64 bytes_written;      /* Bytes accepted by write */
+    u64 commands_written;   /* Complete commands added to the circular buffer */
+    u64 evictions;          /* Commands overwritten when the circular buffer was full */
+    u64 reads;              /* Calls to read */
+    u64 bytes_read;         /* Bytes copied to user space by read */
+    u64 seeks;              /* Successful AESDCHAR_IOCSEEKTO, IOCSEEKSEQ and IOCSEEKTIME calls */
+    u64 lock_wait_ns;       /* Time spent waiting for dev->lock when it was contended */
+    u64 partial_bytes_dropped; /* Incomplete command bytes which didn't fit the handoff on close */
+};
+
 struct aesd_dev
 {
     /**
@@ -36,19 +74,45 @@ struct aesd_dev
 
     struct cdev cdev;     /* Char device structure      */
     struct aesd_circular_buffer buffer; /* Circular buffer for write operations */
+    u64 next_seq;         /* Sequence number of the next command, the oldest is next_seq - count */
     struct mutex lock;   /* Mutex to synchronize access */
-    char partial_write_buffer[AESDCHAR_MAX_WRITE_SIZE]; // Buffer for partial writes
+    seqcount_t seq;       /* Lets readers snapshot the buffer without taking lock, never sleeping */
+    wait_queue_head_t read_queue; /* Readers waiting for a new command to be written */
+    struct fasync_struct *async_queue; /* Processes to send SIGIO when a command is written */
+    char partial_write_buffer[AESDCHAR_MAX_WRITE_SIZE]; // Incomplete command left by a writer which closed the device
     size_t partial_write_size;  // Current size of the partial write buffer
+    struct aesd_mmap_header *mmap_header; // vmalloc_user area shared read-only through mmap
+    struct mutex mmap_lock;     // Serializes updates of mmap_header and the data area after it
+    u64 mmap_seq;               // next_seq as of the last update of the mmap area
+    u64 mmap_slot_seq[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED]; // Sequence number + 1 of the command copied to each data slot, 0 if none
+    struct aesd_stats __percpu *stats; /* Runtime statistics */
+    struct dentry *debugfs_dir; /* Per device debugfs directory */
+
+};
 
+/**
+ * Per open file state, stored in filp->private_data.  Incomplete commands are staged here so
+ * concurrent writers don't interleave partial lines or hold dev->lock while copying.
+ */
+struct aesd_file
+{
+    struct aesd_dev *dev;   /* Device this file was opened on */
+    struct mutex write_lock; /* Serializes writers sharing this file */
+    char partial_write_buffer[AESDCHAR_MAX_WRITE_SIZE]; // Buffer for partial writes through this file
+    size_t partial_write_size;  // Current size of the partial write buffer
+    bool at_end;            /* The last read reached the end of the data, cleared by seeks */
+    loff_t end_pos;         /* When at_end, the file position that read left */
+    u64 end_seq;            /* When at_end, the sequence number of the next command to read */
 };
 
 /* Function prototypes for file operations */
 int aesd_open(struct inode *inode, struct file *filp);
 int aesd_release(struct inode *inode, struct file *filp);
-ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
-                loff_t *f_pos);
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
-                loff_t *f_pos);
+ssize_t aesd_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from);
+__poll_t aesd_poll(struct file *filp, poll_table *wait);
+int aesd_fasync(int fd, struct file *filp, int mode);
+int aesd_mmap(struct file *filp, struct vm_area_struct *vma);
 loff_t aesd_llseek(struct file *filp, loff_t offset, int whence);
 long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 
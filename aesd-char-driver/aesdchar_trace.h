@@ -0,0 +1,128 @@
+/*
+ * aesdchar_trace.h
+ *
+ *  @brief Tracepoints on the aesdchar file operations and device lock, for building latency
+ *  histograms with ftrace or trace-cmd, e.g. trace-cmd record -e aesdchar
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aesdchar
+
+#if !defined(AESD_CHAR_DRIVER_AESDCHAR_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define AESD_CHAR_DRIVER_AESDCHAR_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+/**
+ * Entry and exit of read, write and llseek.  size is the requested count on entry and the
+ * return value on exit, entries is the circular buffer occupancy at the time of the event.
+ */
+DECLARE_EVENT_CLASS(aesd_fop_class,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(ssize_t, size)
+        __field(loff_t, pos)
+        __field(unsigned int, entries)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->size = size;
+        __entry->pos = pos;
+        __entry->entries = entries;
+    ),
+    TP_printk("minor=%u size=%zd pos=%lld entries=%u",
+        __entry->minor, __entry->size, __entry->pos, __entry->entries)
+);
+
+DEFINE_EVENT(aesd_fop_class, aesd_read_enter,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries));
+DEFINE_EVENT(aesd_fop_class, aesd_read_exit,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries));
+DEFINE_EVENT(aesd_fop_class, aesd_write_enter,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries));
+DEFINE_EVENT(aesd_fop_class, aesd_write_exit,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries));
+DEFINE_EVENT(aesd_fop_class, aesd_llseek_enter,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries));
+DEFINE_EVENT(aesd_fop_class, aesd_llseek_exit,
+    TP_PROTO(unsigned int minor, ssize_t size, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, size, pos, entries));
+
+/**
+ * Entry and exit of unlocked_ioctl.  ret is 0 on entry.
+ */
+DECLARE_EVENT_CLASS(aesd_ioctl_class,
+    TP_PROTO(unsigned int minor, unsigned int cmd, long ret, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, cmd, ret, pos, entries),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, cmd)
+        __field(long, ret)
+        __field(loff_t, pos)
+        __field(unsigned int, entries)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->cmd = cmd;
+        __entry->ret = ret;
+        __entry->pos = pos;
+        __entry->entries = entries;
+    ),
+    TP_printk("minor=%u cmd=0x%x ret=%ld pos=%lld entries=%u",
+        __entry->minor, __entry->cmd, __entry->ret, __entry->pos, __entry->entries)
+);
+
+DEFINE_EVENT(aesd_ioctl_class, aesd_ioctl_enter,
+    TP_PROTO(unsigned int minor, unsigned int cmd, long ret, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, cmd, ret, pos, entries));
+DEFINE_EVENT(aesd_ioctl_class, aesd_ioctl_exit,
+    TP_PROTO(unsigned int minor, unsigned int cmd, long ret, loff_t pos, unsigned int entries),
+    TP_ARGS(minor, cmd, ret, pos, entries));
+
+/**
+ * dev->lock acquired after waiting wait_ns (0 when uncontended), and released.  The time
+ * between the two events for a task is the lock hold time.
+ */
+TRACE_EVENT(aesd_lock_acquire,
+    TP_PROTO(unsigned int minor, u64 wait_ns),
+    TP_ARGS(minor, wait_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(u64, wait_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->wait_ns = wait_ns;
+    ),
+    TP_printk("minor=%u wait_ns=%llu", __entry->minor, __entry->wait_ns)
+);
+
+TRACE_EVENT(aesd_lock_release,
+    TP_PROTO(unsigned int minor, unsigned int entries),
+    TP_ARGS(minor, entries),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, entries)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->entries = entries;
+    ),
+    TP_printk("minor=%u entries=%u", __entry->minor, __entry->entries)
+);
+
+#endif /* AESD_CHAR_DRIVER_AESDCHAR_TRACE_H_ */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aesdchar_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,300 @@
+/**
+ * @file aesdchar_bench.c
+ * @brief Benchmark of the aesdchar file operations, built from the driver's main.c against
+ * the userspace shim so it runs without loading the module.
+ *
+ * Usage: aesdchar_bench [-n iterations] [-s command_size] [-w writers] [-r readers]
+ *                       [-b max_bytes] [-e max_entries] [-H]
+ *
+ * Each phase prints the average time per operation.  Run it under perf record or perf stat
+ * to profile the driver code paths.  -H also reports how long each phase held dev->lock per
+ * acquisition, at the cost of two clock reads per lock.
+ */
+#include <unistd.h>
+#include <kshim.h>
+#include "aesdchar.h"
+#include "aesd_ioctl.h"
+
+extern struct aesd_dev *aesd_devices;
+extern struct file_operations aesd_fops;
+extern unsigned long aesd_max_bytes;
+extern int aesd_max_entries;
+extern int aesd_nr_devs;
+
+static long iterations = 1000000;
+static size_t command_size = 64;
+static int nr_writers = 1;
+static int nr_readers = 2;
+
+/**
+ * Open the first aesdchar device into @param filp as the VFS would
+ */
+static void bench_open(struct inode *inode, struct file *filp)
+{
+    memset(filp, 0, sizeof(*filp));
+    inode->i_cdev = &aesd_devices[0].cdev;
+    if (aesd_fops.open(inode, filp)) {
+        fprintf(stderr, "open failed\n");
+        exit(1);
+    }
+}
+
+static void bench_release(struct inode *inode, struct file *filp)
+{
+    aesd_fops.release(inode, filp);
+}
+
+/**
+ * Write @param len bytes of @param buf at the file position, as write(2) does through write_iter
+ */
+static ssize_t bench_write(struct file *filp, const char *buf, size_t len)
+{
+    struct kiocb iocb = { .ki_filp = filp, .ki_pos = filp->f_pos };
+    struct iov_iter iter;
+    ssize_t retval;
+
+    import_ubuf(ITER_SOURCE, (void *)buf, len, &iter);
+    retval = aesd_fops.write_iter(&iocb, &iter);
+    if (retval > 0)
+        filp->f_pos = iocb.ki_pos;
+    return retval;
+}
+
+/**
+ * Read up to @param len bytes into @param buf from the file position, as read(2) does
+ */
+static ssize_t bench_read(struct file *filp, char *buf, size_t len)
+{
+    struct kiocb iocb = { .ki_filp = filp, .ki_pos = filp->f_pos };
+    struct iov_iter iter;
+    ssize_t retval;
+
+    import_ubuf(ITER_DEST, buf, len, &iter);
+    retval = aesd_fops.read_iter(&iocb, &iter);
+    if (retval > 0)
+        filp->f_pos = iocb.ki_pos;
+    return retval;
+}
+
+static void report(const char *name, long ops, u64 elapsed_ns)
+{
+    printf("%-24s %10ld ops %10.1f ns/op\n", name, ops, (double)elapsed_ns / ops);
+}
+
+static void lock_hold_reset(void)
+{
+    aesd_devices[0].lock.hold_ns = 0;
+    aesd_devices[0].lock.holds = 0;
+}
+
+/**
+ * With -H, print the average dev->lock hold time since lock_hold_reset()
+ */
+static void lock_hold_report(const char *name)
+{
+    struct mutex *lock = &aesd_devices[0].lock;
+
+    if (!kshim_lock_hold_stats || !lock->holds)
+        return;
+    printf("%-24s %10llu holds %8.1f ns/hold\n", name, lock->holds, (double)lock->hold_ns / lock->holds);
+}
+
+/**
+ * Fill @param buf with a command of command_size bytes ending in a newline
+ */
+static void make_command(char *buf)
+{
+    memset(buf, 'a', command_size - 1);
+    buf[command_size - 1] = '\n';
+}
+
+static void bench_single_thread(void)
+{
+    struct inode inode;
+    struct file filp;
+    struct aesd_seekto seekto;
+    char command[AESDCHAR_MAX_WRITE_SIZE];
+    char *data;
+    size_t data_size = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED * AESDCHAR_MAX_WRITE_SIZE;
+    u64 start;
+    long i;
+
+    data = malloc(data_size);
+    if (!data) {
+        perror("malloc");
+        exit(1);
+    }
+
+    bench_open(&inode, &filp);
+    make_command(command);
+
+    lock_hold_reset();
+    start = ktime_get_ns();
+    for (i = 0; i < iterations; i++) {
+        bench_write(&filp, command, command_size);
+    }
+    report("write", iterations, ktime_get_ns() - start);
+    lock_hold_report("write lock hold");
+
+    start = ktime_get_ns();
+    for (i = 0; i < iterations; i++) {
+        aesd_fops.llseek(&filp, 0, SEEK_SET);
+        bench_read(&filp, data, data_size);
+    }
+    report("read all", iterations, ktime_get_ns() - start);
+
+    start = ktime_get_ns();
+    for (i = 0; i < iterations; i++) {
+        aesd_fops.llseek(&filp, 0, SEEK_SET);
+        bench_read(&filp, data, command_size);
+    }
+    report("read one command", iterations, ktime_get_ns() - start);
+
+    start = ktime_get_ns();
+    for (i = 0; i < iterations; i++) {
+        aesd_fops.llseek(&filp, i % command_size, SEEK_SET);
+    }
+    report("llseek", iterations, ktime_get_ns() - start);
+
+    start = ktime_get_ns();
+    for (i = 0; i < iterations; i++) {
+        seekto.write_cmd = 0;
+        seekto.write_cmd_offset = i % command_size;
+        aesd_fops.unlocked_ioctl(&filp, AESDCHAR_IOCSEEKTO, (unsigned long)&seekto);
+    }
+    report("ioctl seekto", iterations, ktime_get_ns() - start);
+
+    bench_release(&inode, &filp);
+    free(data);
+}
+
+static void *writer_thread(void *arg)
+{
+    struct inode inode;
+    struct file filp;
+    char command[AESDCHAR_MAX_WRITE_SIZE];
+    long i;
+
+    bench_open(&inode, &filp);
+    make_command(command);
+    for (i = 0; i < iterations; i++) {
+        bench_write(&filp, command, command_size);
+    }
+    bench_release(&inode, &filp);
+    return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+    struct inode inode;
+    struct file filp;
+    char data[AESDCHAR_MAX_WRITE_SIZE];
+    long i;
+
+    bench_open(&inode, &filp);
+    for (i = 0; i < iterations; i++) {
+        if (bench_read(&filp, data, sizeof(data)) <= 0)
+            aesd_fops.llseek(&filp, 0, SEEK_SET);
+    }
+    bench_release(&inode, &filp);
+    return NULL;
+}
+
+static void bench_threads(void)
+{
+    pthread_t threads[nr_writers + nr_readers];
+    u64 start;
+    int i;
+
+    lock_hold_reset();
+    start = ktime_get_ns();
+    for (i = 0; i < nr_writers + nr_readers; i++) {
+        if (pthread_create(&threads[i], NULL, i < nr_writers ? writer_thread : reader_thread, NULL)) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (i = 0; i < nr_writers + nr_readers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    printf("%d writers %d readers %14ld ops %10.1f ns/op per thread\n", nr_writers, nr_readers,
+            iterations, (double)(ktime_get_ns() - start) / iterations);
+    lock_hold_report("threads lock hold");
+}
+
+/**
+ * Print the statistics of the first device through the driver's own sysfs attributes
+ */
+static void print_stats(void)
+{
+    struct device *device = kshim_device_find(aesd_devices[0].cdev.dev);
+    struct attribute **attr;
+    struct device_attribute *dev_attr;
+    char buf[PAGE_SIZE];
+
+    if (!device)
+        return;
+
+    for (attr = device->groups[0]->attrs; *attr; attr++) {
+        dev_attr = container_of(*attr, struct device_attribute, attr);
+        dev_attr->show(device, dev_attr, buf);
+        printf("%-24s %s", (*attr)->name, buf);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:w:r:b:e:H")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 's':
+            command_size = atol(optarg);
+            break;
+        case 'w':
+            nr_writers = atoi(optarg);
+            break;
+        case 'r':
+            nr_readers = atoi(optarg);
+            break;
+        case 'b':
+            aesd_max_bytes = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            aesd_max_entries = atoi(optarg);
+            break;
+        case 'H':
+            kshim_lock_hold_stats = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n iterations] [-s command_size] [-w writers] [-r readers] "
+                    "[-b max_bytes] [-e max_entries] [-H]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (iterations < 1 || command_size < 1 || command_size > AESDCHAR_MAX_WRITE_SIZE ||
+            nr_writers < 0 || nr_readers < 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    aesd_nr_devs = 1;
+    if (aesd_init_module()) {
+        fprintf(stderr, "aesd_init_module failed\n");
+        return 1;
+    }
+
+    bench_single_thread();
+    if (nr_writers + nr_readers > 0) {
+        bench_threads();
+    }
+    print_stats();
+
+    aesd_cleanup_module();
+    rcu_barrier();
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file aesdchar_test.c
+ * @brief Checks of the aesdchar ioctls at the edges of the stored commands, built from the
+ * driver's main.c against the userspace shim like aesdchar_bench.
+ *
+ * Usage: aesdchar_test
+ *
+ * Prints each failed check and exits non-zero if any failed.
+ */
+#include <kshim.h>
+#include "aesdchar.h"
+#include "aesd_ioctl.h"
+
+extern struct aesd_dev *aesd_devices;
+extern struct file_operations aesd_fops;
+extern int aesd_max_entries;
+extern int aesd_nr_devs;
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void test_write(struct file *filp, const char *command)
+{
+    struct kiocb iocb = { .ki_filp = filp, .ki_pos = filp->f_pos };
+    struct iov_iter iter;
+
+    import_ubuf(ITER_SOURCE, (void *)command, strlen(command), &iter);
+    CHECK(aesd_fops.write_iter(&iocb, &iter) == (ssize_t)strlen(command));
+}
+
+/**
+ * Issue @param cmd with a struct aesd_seqread for command @param seq at @param seq_offset
+ * @return the ioctl's result, with @param seqread as the driver left it
+ */
+static long seq_ioctl(struct file *filp, unsigned int cmd, struct aesd_seqread *seqread, char *buf,
+        size_t len, u64 seq, uint32_t seq_offset)
+{
+    memset(seqread, 0, sizeof(*seqread));
+    seqread->seq = seq;
+    seqread->seq_offset = seq_offset;
+    seqread->buf = (uintptr_t)buf;
+    seqread->len = len;
+    return aesd_fops.unlocked_ioctl(filp, cmd, (unsigned long)seqread);
+}
+
+/**
+ * AESDCHAR_IOCREADSEQ and AESDCHAR_IOCSEEKSEQ must accept and refuse the same positions
+ */
+static void test_seq_bounds(struct file *filp)
+{
+    struct aesd_seqread seqread;
+    char buf[64];
+    long retval;
+
+    // Four commands of 6 bytes with max_entries 3, so 1 to 3 are stored and 4 is next
+    test_write(filp, "cmd00\n");
+    test_write(filp, "cmd01\n");
+    test_write(filp, "cmd02\n");
+    test_write(filp, "cmd03\n");
+
+    retval = seq_ioctl(filp, AESDCHAR_IOCREADSEQ, &seqread, buf, sizeof(buf), 1, 2);
+    CHECK(retval == 16);
+    CHECK(memcmp(buf, "d01\ncmd02\ncmd03\n", 16) == 0);
+    CHECK(seqread.seq == 4 && seqread.seq_offset == 0);
+    CHECK(seqread.first_seq == 1 && seqread.next_seq == 4);
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCSEEKSEQ, &seqread, NULL, 0, 1, 2) == 0);
+    CHECK(filp->f_pos == 2);
+
+    // The next command at offset 0 is the end of the data
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCREADSEQ, &seqread, buf, sizeof(buf), 4, 0) == 0);
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCSEEKSEQ, &seqread, NULL, 0, 4, 0) == 0);
+    CHECK(filp->f_pos == 18);
+
+    // Any other offset into the next command isn't written yet
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCREADSEQ, &seqread, buf, sizeof(buf), 4, 1) == -EINVAL);
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCSEEKSEQ, &seqread, NULL, 0, 4, 1) == -EINVAL);
+
+    // Beyond the next command
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCREADSEQ, &seqread, buf, sizeof(buf), 5, 0) == -EINVAL);
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCSEEKSEQ, &seqread, NULL, 0, 5, 0) == -EINVAL);
+
+    // Past the end of a stored command
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCREADSEQ, &seqread, buf, sizeof(buf), 2, 6) == -EINVAL);
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCSEEKSEQ, &seqread, NULL, 0, 2, 6) == -EINVAL);
+
+    // Evicted, both report where to resume
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCREADSEQ, &seqread, buf, sizeof(buf), 0, 0) == -ESTALE);
+    CHECK(seqread.first_seq == 1);
+    CHECK(seq_ioctl(filp, AESDCHAR_IOCSEEKSEQ, &seqread, NULL, 0, 0, 0) == -ESTALE);
+    CHECK(seqread.first_seq == 1);
+}
+
+int main(void)
+{
+    struct inode inode;
+    struct file filp;
+
+    aesd_nr_devs = 1;
+    aesd_max_entries = 3;
+    if (aesd_init_module()) {
+        fprintf(stderr, "aesd_init_module failed\n");
+        return 1;
+    }
+
+    memset(&filp, 0, sizeof(filp));
+    inode.i_cdev = &aesd_devices[0].cdev;
+    if (aesd_fops.open(&inode, &filp)) {
+        fprintf(stderr, "open failed\n");
+        return 1;
+    }
+
+    test_seq_bounds(&filp);
+
+    aesd_fops.release(&inode, &filp);
+    aesd_cleanup_module();
+    rcu_barrier();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,207 @@
+/**
+ * @file atomic_ring_stress.c
+ * @brief Producer/consumer stress test of the rings in aesd-atomic-ring.h
+ *
+ * Usage: atomic-ring-stress [-n items] [-p producers]
+ *
+ * One producer and one consumer pass the given number of items through an SPSC ring, then
+ * the given number of producers (default 4) each pass that many items through an MPSC ring
+ * to one consumer.  Producers alternate single and batch pushes and the consumer alternates
+ * single and batch pops.  Every item carries its producer and sequence number, and the
+ * consumer checks each producer's items arrive complete and in order.  Exits non-zero on the
+ * first lost, repeated or reordered item.
+ *
+ * The rings are small so they are full and empty often.  Build with -fsanitize=thread to
+ * check the memory ordering as well, see the README.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "aesd-atomic-ring.h"
+
+#define STRESS_CAPACITY 16
+#define STRESS_BATCH 5 // not a divisor of the capacity, so batches straddle the wrap
+#define STRESS_MAX_PRODUCERS 64
+
+struct stress_item {
+    unsigned int producer;
+    uint64_t seq;
+};
+
+AESD_SPSC_RING_DEFINE(stress_spsc, struct stress_item, STRESS_CAPACITY);
+AESD_MPSC_RING_DEFINE(stress_mpsc, struct stress_item, STRESS_CAPACITY);
+
+// Static storage, as malloc() doesn't guarantee the rings' AESD_CACHELINE_SIZE alignment
+static struct stress_spsc spsc;
+static struct stress_mpsc mpsc;
+
+static uint64_t items = 1000000;
+static unsigned int producers = 4;
+static bool mpsc_phase; // set before the producer threads of each phase start
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Push @param count items starting at @param seq for @param producer, yielding while the
+ * ring is full.  @param mpsc_ring selects the ring.
+ */
+static void push_items(bool mpsc_ring, unsigned int producer, uint64_t seq, size_t count)
+{
+    struct stress_item batch[STRESS_BATCH];
+    size_t pushed = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        batch[i].producer = producer;
+        batch[i].seq = seq + i;
+    }
+    while (pushed < count) {
+        size_t n;
+
+        if (count == 1)
+            n = mpsc_ring ? stress_mpsc_push(&mpsc, batch) : stress_spsc_push(&spsc, batch);
+        else if (mpsc_ring)
+            n = stress_mpsc_push_batch(&mpsc, batch + pushed, count - pushed);
+        else
+            n = stress_spsc_push_batch(&spsc, batch + pushed, count - pushed);
+        if (n == 0)
+            sched_yield();
+        pushed += n;
+    }
+}
+
+static void *producer_thread(void *arg)
+{
+    unsigned int producer = (unsigned int)(uintptr_t)arg;
+    uint64_t seq = 0;
+
+    // Alternate a single push with a batch of up to STRESS_BATCH
+    while (seq < items) {
+        size_t count = (seq / 2) % 2 ? STRESS_BATCH : 1;
+
+        if (count > items - seq)
+            count = items - seq;
+        push_items(mpsc_phase, producer, seq, count);
+        seq += count;
+    }
+    return NULL;
+}
+
+/**
+ * Pop @param nr_producers * items items, checking each producer's items arrive in order
+ * @return true if every item arrived exactly once and in order
+ */
+static bool consume(bool mpsc_ring, unsigned int nr_producers)
+{
+    static uint64_t expected[STRESS_MAX_PRODUCERS];
+    struct stress_item batch[STRESS_BATCH];
+    uint64_t remaining = items * nr_producers;
+    uint64_t pops = 0;
+    unsigned int p;
+
+    for (p = 0; p < nr_producers; p++)
+        expected[p] = 0;
+
+    while (remaining) {
+        size_t want = pops++ % 2 ? STRESS_BATCH : 1;
+        size_t n;
+        size_t i;
+
+        if (mpsc_ring)
+            n = stress_mpsc_pop_batch(&mpsc, batch, want);
+        else
+            n = stress_spsc_pop_batch(&spsc, batch, want);
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (batch[i].producer >= nr_producers || batch[i].seq != expected[batch[i].producer]) {
+                fprintf(stderr, "%s: producer %u item %llu arrived, expected %llu\n",
+                        mpsc_ring ? "mpsc" : "spsc", batch[i].producer,
+                        (unsigned long long)batch[i].seq,
+                        batch[i].producer < nr_producers ?
+                        (unsigned long long)expected[batch[i].producer] : 0ull);
+                return false;
+            }
+            expected[batch[i].producer]++;
+        }
+        remaining -= n;
+    }
+    return true;
+}
+
+/**
+ * Run @param nr_producers producer threads against a consumer on this thread
+ * @return true if the consumer saw every item in order
+ */
+static bool run(const char *name, bool mpsc_ring, unsigned int nr_producers)
+{
+    pthread_t threads[STRESS_MAX_PRODUCERS];
+    uint64_t start;
+    unsigned int p;
+    bool success;
+
+    mpsc_phase = mpsc_ring;
+    if (mpsc_ring)
+        stress_mpsc_init(&mpsc);
+    else
+        stress_spsc_init(&spsc);
+
+    start = now_ns();
+    for (p = 0; p < nr_producers; p++) {
+        if (pthread_create(&threads[p], NULL, producer_thread, (void *)(uintptr_t)p) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    success = consume(mpsc_ring, nr_producers);
+    if (!success)
+        return false;
+    for (p = 0; p < nr_producers; p++)
+        pthread_join(threads[p], NULL);
+
+    printf("%-5s %2u producer(s) %10llu items %8.1f ns/item\n", name, nr_producers,
+            (unsigned long long)(items * nr_producers),
+            (double)(now_ns() - start) / (items * nr_producers));
+    return success;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            items = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            producers = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n items] [-p producers]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (items < 1 || producers < 1 || producers > STRESS_MAX_PRODUCERS) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    if (!run("spsc", false, 1) || !run("mpsc", true, producers))
+        return 1;
+    printf("All items arrived in order\n");
+    return 0;
+}
@@ -0,0 +1,289 @@
+/**
+ * @file circular_buffer_bench.c
+ * @brief Microbenchmark of aesd_circular_buffer_add_entry and
+ * aesd_circular_buffer_find_entry_offset_for_fpos
+ *
+ * Usage: circular-buffer-bench [-n ops] [-o results.csv]
+ *
+ * Every combination of ring depth, entry size distribution and (for find) access pattern is
+ * timed over the given number of operations.  Results are printed and written as CSV with
+ * one row per combination: benchmark,depth,sizes,pattern,ops,ns_per_op,cache_misses_per_op.
+ * cache_misses_per_op is -1 when hardware counters aren't available, e.g. in a container or
+ * with kernel.perf_event_paranoid > 2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "aesd-circular-buffer.h"
+
+#define BENCH_MAX_SIZE 1024 // matches AESDCHAR_MAX_WRITE_SIZE
+#define BENCH_TABLE_SIZE 4096 // precomputed sizes and positions, a power of 2
+
+enum size_distribution {
+    SIZES_FIXED,    // every entry 64 bytes
+    SIZES_UNIFORM,  // 1 to BENCH_MAX_SIZE bytes
+    SIZES_BIMODAL,  // 90% 16 byte entries, 10% BENCH_MAX_SIZE
+    SIZES_COUNT
+};
+
+static const char *size_names[SIZES_COUNT] = { "fixed64", "uniform", "bimodal" };
+
+enum access_pattern {
+    PATTERN_SEQUENTIAL, // walk the data front to back as a reader would
+    PATTERN_RANDOM,     // uniformly random offsets
+    PATTERN_OLDEST,     // offsets in the oldest entry
+    PATTERN_NEWEST,     // offsets in the newest entry, the worst case for the linear search
+    PATTERN_COUNT
+};
+
+static const char *pattern_names[PATTERN_COUNT] = { "sequential", "random", "oldest", "newest" };
+
+static char data[BENCH_MAX_SIZE];
+static size_t sizes[BENCH_TABLE_SIZE];
+static size_t positions[BENCH_TABLE_SIZE];
+static volatile size_t sink;
+static int perf_fd = -1;
+
+/**
+ * Deterministic xorshift generator so every run uses the same sizes and offsets
+ */
+static uint32_t next_random(void)
+{
+    static uint32_t state = 2463534242u;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Open a hardware cache miss counter for this thread, leaving perf_fd at -1 if unavailable
+ */
+static void perf_open(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd < 0) {
+        fprintf(stderr, "perf_event_open: cache misses not available, reporting -1\n");
+    }
+}
+
+static void perf_start(void)
+{
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/**
+ * @return the cache misses since perf_start(), or -1 if not counted
+ */
+static long long perf_stop(void)
+{
+    long long count;
+
+    if (perf_fd < 0)
+        return -1;
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(perf_fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+    return count;
+}
+
+static void fill_sizes(enum size_distribution distribution)
+{
+    int i;
+
+    for (i = 0; i < BENCH_TABLE_SIZE; i++) {
+        switch (distribution) {
+        case SIZES_FIXED:
+            sizes[i] = 64;
+            break;
+        case SIZES_UNIFORM:
+            sizes[i] = 1 + next_random() % BENCH_MAX_SIZE;
+            break;
+        default:
+            sizes[i] = next_random() % 10 ? 16 : BENCH_MAX_SIZE;
+            break;
+        }
+    }
+}
+
+/**
+ * Add the entry of @param size to @param buffer, evicting as the aesdchar driver does to keep
+ * within the depth set in max_entries
+ */
+static void add_entry(struct aesd_circular_buffer *buffer, size_t size)
+{
+    struct aesd_buffer_entry entry = { .buffptr = data, .size = size };
+    struct aesd_buffer_entry removed;
+
+    while (aesd_circular_buffer_needs_eviction(buffer, size) &&
+            aesd_circular_buffer_remove_oldest(buffer, &removed)) {
+        sink += removed.size;
+    }
+    aesd_circular_buffer_add_entry(buffer, &entry);
+}
+
+static void report(FILE *out, const char *benchmark, int depth, enum size_distribution distribution,
+        const char *pattern, long ops, uint64_t elapsed_ns, long long misses)
+{
+    double misses_per_op = misses < 0 ? -1 : (double)misses / ops;
+
+    printf("%-6s depth %2d %-8s %-10s %8.2f ns/op %8.3f misses/op\n", benchmark, depth,
+            size_names[distribution], pattern, (double)elapsed_ns / ops, misses_per_op);
+    fprintf(out, "%s,%d,%s,%s,%ld,%.3f,%.4f\n", benchmark, depth, size_names[distribution],
+            pattern, ops, (double)elapsed_ns / ops, misses_per_op);
+}
+
+static void bench_add(FILE *out, int depth, enum size_distribution distribution, long ops)
+{
+    struct aesd_circular_buffer buffer;
+    uint64_t start, elapsed;
+    long long misses;
+    long i;
+
+    aesd_circular_buffer_init(&buffer);
+    buffer.max_entries = depth;
+
+    perf_start();
+    start = now_ns();
+    for (i = 0; i < ops; i++) {
+        add_entry(&buffer, sizes[i & (BENCH_TABLE_SIZE - 1)]);
+    }
+    elapsed = now_ns() - start;
+    misses = perf_stop();
+
+    report(out, "add", depth, distribution, "-", ops, elapsed, misses);
+}
+
+static void bench_find(FILE *out, int depth, enum size_distribution distribution,
+        enum access_pattern pattern, long ops)
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry *newest;
+    size_t newest_start;
+    size_t entry_offset;
+    uint64_t start, elapsed;
+    long long misses;
+    long i;
+    int j;
+
+    // Fill to the depth, starting part way around the ring so the entries wrap
+    aesd_circular_buffer_init(&buffer);
+    buffer.max_entries = depth;
+    for (j = 0; j < depth + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED / 2; j++) {
+        add_entry(&buffer, sizes[j]);
+    }
+
+    newest = &buffer.entry[(buffer.in_offs + AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - 1) %
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    newest_start = buffer.total_size - newest->size;
+    for (j = 0; j < BENCH_TABLE_SIZE; j++) {
+        switch (pattern) {
+        case PATTERN_SEQUENTIAL:
+            positions[j] = (size_t)j * 61 % buffer.total_size;
+            break;
+        case PATTERN_RANDOM:
+            positions[j] = next_random() % buffer.total_size;
+            break;
+        case PATTERN_OLDEST:
+            positions[j] = next_random() % buffer.entry[buffer.out_offs].size;
+            break;
+        default:
+            positions[j] = newest_start + next_random() % newest->size;
+            break;
+        }
+    }
+
+    perf_start();
+    start = now_ns();
+    for (i = 0; i < ops; i++) {
+        sink += (size_t)aesd_circular_buffer_find_entry_offset_for_fpos(&buffer,
+                positions[i & (BENCH_TABLE_SIZE - 1)], &entry_offset) + entry_offset;
+    }
+    elapsed = now_ns() - start;
+    misses = perf_stop();
+
+    report(out, "find", depth, distribution, pattern_names[pattern], ops, elapsed, misses);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "circular_buffer_bench.csv";
+    long ops = 10000000;
+    FILE *out;
+    int depth;
+    int distribution;
+    int pattern;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ops = atol(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ops] [-o results.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (ops < 1) {
+        fprintf(stderr, "Invalid number of operations\n");
+        return 1;
+    }
+
+    out = fopen(output, "w");
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    fprintf(out, "benchmark,depth,sizes,pattern,ops,ns_per_op,cache_misses_per_op\n");
+
+    perf_open();
+
+    for (distribution = 0; distribution < SIZES_COUNT; distribution++) {
+        fill_sizes(distribution);
+        for (depth = 1; depth <= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; depth++) {
+            bench_add(out, depth, distribution, ops);
+            for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+                bench_find(out, depth, distribution, pattern, ops);
+            }
+        }
+    }
+
+    if (perf_fd >= 0) {
+        close(perf_fd);
+    }
+    fclose(out);
+    printf("Results written to %s\n", output);
+    return 0;
+}
@@ -0,0 +1,529 @@
+/*
+ * kshim.h
+ *
+ *  @brief Userspace stand-ins for the kernel interfaces used by the aesdchar driver, so
+ *  main.c can be built into an ordinary program and benchmarked with perf.  Every
+ *  linux/ header the driver includes resolves to this file.
+ *
+ *  Allocation maps to malloc, struct mutex to a pthread mutex, wait queues to a condition
+ *  variable and user copies to memcpy.  RCU readers take a shared rwlock and kfree_rcu
+ *  frees in batches once the writer side of that lock proves the readers are gone, which
+ *  is safe but slower than the real thing.  Per-CPU data gets one slot per thread.
+ */
+#ifndef AESD_CHAR_DRIVER_HARNESS_KSHIM_H_
+#define AESD_CHAR_DRIVER_HARNESS_KSHIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/types.h>
+
+/* Types */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef long long s64;
+typedef unsigned int gfp_t;
+typedef unsigned int __poll_t;
+typedef unsigned short umode_t;
+
+#define __user
+#define __percpu
+#define __init
+#define __exit
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define ERESTARTSYS 512
+
+/* Helpers from linux/kernel.h and friends */
+#define min(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a > _b ? _a : _b; })
+#define min_t(type, a, b) ({ type _a = (a); type _b = (b); _a < _b ? _a : _b; })
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#define struct_size(p, member, count) (sizeof(*(p)) + (count) * sizeof((p)->member[0]))
+#define BUILD_BUG_ON(condition) _Static_assert(!(condition), #condition)
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *)&(x) = (val))
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define MAX_ERRNO 4095
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+#define PTR_ERR(ptr) ((long)(ptr))
+#define ERR_PTR(err) ((void *)(long)(err))
+
+/* printk */
+#define KERN_ERR "<3>"
+#define KERN_WARNING "<4>"
+#define KERN_INFO "<6>"
+#define KERN_DEBUG "<7>"
+#define printk(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define printk_ratelimited printk
+
+/* Module boilerplate, the init and exit functions are called directly by the harness */
+struct module;
+#define THIS_MODULE ((struct module *)NULL)
+#define MODULE_AUTHOR(x) extern int kshim_modinfo
+#define MODULE_LICENSE(x) extern int kshim_modinfo
+#define MODULE_PARM_DESC(name, desc) extern int kshim_modinfo
+#define module_param_named(name, value, type, perm) extern int kshim_modinfo
+#define module_init(fn) static int (*const kshim_initcall)(void) __attribute__((unused)) = fn
+#define module_exit(fn) static void (*const kshim_exitcall)(void) __attribute__((unused)) = fn
+#define S_IRUGO 0444
+
+/* Kernel version, selects the newest code paths in the driver */
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 5, 0)
+
+/* Memory allocation */
+#define GFP_KERNEL 0
+#define PAGE_SIZE 4096UL
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+static inline void *kmalloc(size_t size, gfp_t flags) { return malloc(size); }
+static inline void *kzalloc(size_t size, gfp_t flags) { return calloc(1, size); }
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags) { return calloc(n, size); }
+static inline void kfree(const void *ptr) { free((void *)ptr); }
+
+static inline void *vmalloc_user(unsigned long size)
+{
+    void *ptr;
+
+    if (posix_memalign(&ptr, PAGE_SIZE, size))
+        return NULL;
+    return memset(ptr, 0, size);
+}
+static inline void vfree(const void *ptr) { free((void *)ptr); }
+
+/* User copies, "user" pointers are plain pointers in the harness */
+static inline unsigned long copy_to_user(void __user *to, const void *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+static inline unsigned long copy_from_user(void *to, const void __user *from, unsigned long n)
+{
+    memcpy(to, from, n);
+    return 0;
+}
+#define u64_to_user_ptr(x) ((void __user *)(uintptr_t)(x))
+
+/* Time */
+static inline u64 ktime_get_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Mutexes.  While kshim_lock_hold_stats is set each mutex sums how long it was held. */
+extern bool kshim_lock_hold_stats;
+
+struct mutex {
+    pthread_mutex_t mutex;
+    u64 acquired_ns;    /* When the current holder took it */
+    u64 hold_ns;        /* Total time held, updated by the holder */
+    u64 holds;          /* Number of times held */
+};
+
+static inline void kshim_mutex_acquired(struct mutex *lock)
+{
+    if (kshim_lock_hold_stats)
+        lock->acquired_ns = ktime_get_ns();
+}
+
+static inline void mutex_init(struct mutex *lock)
+{
+    pthread_mutex_init(&lock->mutex, NULL);
+    lock->hold_ns = 0;
+    lock->holds = 0;
+}
+
+static inline void mutex_lock(struct mutex *lock)
+{
+    pthread_mutex_lock(&lock->mutex);
+    kshim_mutex_acquired(lock);
+}
+
+static inline int mutex_lock_interruptible(struct mutex *lock)
+{
+    mutex_lock(lock);
+    return 0;
+}
+
+static inline int mutex_trylock(struct mutex *lock)
+{
+    if (pthread_mutex_trylock(&lock->mutex))
+        return 0;
+    kshim_mutex_acquired(lock);
+    return 1;
+}
+
+static inline void mutex_unlock(struct mutex *lock)
+{
+    if (kshim_lock_hold_stats) {
+        lock->hold_ns += ktime_get_ns() - lock->acquired_ns;
+        lock->holds++;
+    }
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+/* Sequence counters, writers are serialized by the caller */
+typedef struct {
+    unsigned int sequence;
+} seqcount_t;
+
+#define seqcount_init(s) ((s)->sequence = 0)
+
+/* No-ops, a descheduled writer just leaves readers spinning in read_seqcount_begin() */
+#define preempt_disable() do { } while (0)
+#define preempt_enable() do { } while (0)
+
+static inline unsigned int read_seqcount_begin(const seqcount_t *s)
+{
+    unsigned int seq;
+
+    while ((seq = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE)) & 1)
+        cpu_relax();
+    return seq;
+}
+
+static inline int read_seqcount_retry(const seqcount_t *s, unsigned int start)
+{
+    smp_rmb();
+    return __atomic_load_n(&s->sequence, __ATOMIC_RELAXED) != start;
+}
+
+static inline void write_seqcount_begin(seqcount_t *s)
+{
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+    smp_wmb();
+}
+
+static inline void write_seqcount_end(seqcount_t *s)
+{
+    smp_wmb();
+    __atomic_store_n(&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+}
+
+/* Reference counts */
+typedef struct {
+    int refs;
+} refcount_t;
+
+static inline void refcount_set(refcount_t *r, int n) { __atomic_store_n(&r->refs, n, __ATOMIC_RELAXED); }
+
+static inline bool refcount_inc_not_zero(refcount_t *r)
+{
+    int old = __atomic_load_n(&r->refs, __ATOMIC_RELAXED);
+
+    do {
+        if (!old)
+            return false;
+    } while (!__atomic_compare_exchange_n(&r->refs, &old, old + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+static inline bool refcount_dec_and_test(refcount_t *r)
+{
+    return __atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+/* RCU */
+struct rcu_head {
+    struct rcu_head *next;
+    void *ptr;
+};
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void kshim_kfree_rcu(struct rcu_head *head, void *ptr);
+void rcu_barrier(void);
+#define kfree_rcu(ptr, field) kshim_kfree_rcu(&(ptr)->field, (ptr))
+
+/* Wait queues and poll */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+    pthread_mutex_init(&wq->mutex, NULL);
+    pthread_cond_init(&wq->cond, NULL);
+}
+
+static inline void wake_up_interruptible(wait_queue_head_t *wq)
+{
+    pthread_mutex_lock(&wq->mutex);
+    pthread_cond_broadcast(&wq->cond);
+    pthread_mutex_unlock(&wq->mutex);
+}
+
+#define wait_event_interruptible(wq, condition) ({ \
+    pthread_mutex_lock(&(wq).mutex); \
+    while (!(condition)) \
+        pthread_cond_wait(&(wq).cond, &(wq).mutex); \
+    pthread_mutex_unlock(&(wq).mutex); \
+    0; \
+})
+
+#define EPOLLIN 0x00000001
+#define EPOLLOUT 0x00000004
+#define EPOLLRDNORM 0x00000040
+#define EPOLLWRNORM 0x00000100
+
+struct file;
+typedef struct poll_table_struct poll_table;
+static inline void poll_wait(struct file *filp, wait_queue_head_t *wq, poll_table *p) { }
+
+/* SIGIO registration is tracked, but no signal is sent */
+#ifndef POLL_IN
+#define POLL_IN 1
+#endif
+
+struct fasync_struct {
+    struct file *filp;
+};
+
+static inline int fasync_helper(int fd, struct file *filp, int on, struct fasync_struct **fapp)
+{
+    static struct fasync_struct fasync;
+
+    if (on) {
+        fasync.filp = filp;
+        *fapp = &fasync;
+    } else if (*fapp && (*fapp)->filp == filp) {
+        *fapp = NULL;
+    }
+    return 0;
+}
+
+static inline void kill_fasync(struct fasync_struct **fp, int sig, int band) { }
+
+/* Per-CPU data, each thread gets its own slot of KSHIM_PERCPU_STRIDE bytes */
+#define KSHIM_NR_CPUS 64
+#define KSHIM_PERCPU_STRIDE 256
+
+int kshim_this_cpu(void);
+#define alloc_percpu(type) ({ \
+    BUILD_BUG_ON(sizeof(type) > KSHIM_PERCPU_STRIDE); \
+    (type *)calloc(KSHIM_NR_CPUS, KSHIM_PERCPU_STRIDE); \
+})
+#define free_percpu(ptr) free(ptr)
+#define per_cpu_ptr(ptr, cpu) ((__typeof__(ptr))((char *)(ptr) + (cpu) * KSHIM_PERCPU_STRIDE))
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < KSHIM_NR_CPUS; (cpu)++)
+#define this_cpu_add(pcp, val) \
+    __atomic_fetch_add((__typeof__(&(pcp)))((char *)&(pcp) + kshim_this_cpu() * KSHIM_PERCPU_STRIDE), \
+            (val), __ATOMIC_RELAXED)
+#define this_cpu_inc(pcp) this_cpu_add(pcp, 1)
+
+/* Devices and files */
+#define MINORBITS 20
+#define MINORMASK ((1U << MINORBITS) - 1)
+#define MAJOR(dev) ((unsigned int)((dev) >> MINORBITS))
+#define MINOR(dev) ((unsigned int)((dev) & MINORMASK))
+#define MKDEV(ma, mi) (((ma) << MINORBITS) | (mi))
+
+struct cdev {
+    struct module *owner;
+    const struct file_operations *ops;
+    dev_t dev;
+};
+
+struct inode {
+    struct cdev *i_cdev;
+};
+
+struct file {
+    void *private_data;
+    loff_t f_pos;
+    unsigned int f_flags;
+};
+
+#define IOCB_NOWAIT (1 << 3)
+
+struct kiocb {
+    struct file *ki_filp;
+    loff_t ki_pos;
+    int ki_flags;
+};
+
+#define ITER_SOURCE 1
+#define ITER_DEST 0
+#define MAX_RW_COUNT (INT32_MAX & ~(PAGE_SIZE - 1))
+
+struct kvec {
+    void *iov_base;
+    size_t iov_len;
+};
+
+struct iov_iter {
+    char *buf;
+    size_t count;
+};
+
+static inline size_t iov_iter_count(const struct iov_iter *i) { return i->count; }
+
+static inline int import_ubuf(int rw, void __user *buf, size_t len, struct iov_iter *i)
+{
+    i->buf = buf;
+    i->count = len;
+    return 0;
+}
+
+static inline size_t copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
+{
+    bytes = min(bytes, i->count);
+    memcpy(i->buf, addr, bytes);
+    i->buf += bytes;
+    i->count -= bytes;
+    return bytes;
+}
+
+static inline bool copy_from_iter_full(void *addr, size_t bytes, struct iov_iter *i)
+{
+    if (bytes > i->count)
+        return false;
+    memcpy(addr, i->buf, bytes);
+    i->buf += bytes;
+    i->count -= bytes;
+    return true;
+}
+
+#define VM_WRITE 0x00000002
+#define VM_MAYWRITE 0x00000020
+
+struct vm_area_struct {
+    unsigned long vm_flags;
+    unsigned long vm_pgoff;
+};
+
+static inline void vm_flags_clear(struct vm_area_struct *vma, unsigned long flags) { vma->vm_flags &= ~flags; }
+static inline int remap_vmalloc_range(struct vm_area_struct *vma, void *addr, unsigned long pgoff) { return 0; }
+
+struct seq_file;
+struct pipe_inode_info;
+
+struct file_operations {
+    struct module *owner;
+    loff_t (*llseek)(struct file *, loff_t, int);
+    ssize_t (*read_iter)(struct kiocb *, struct iov_iter *);
+    ssize_t (*write_iter)(struct kiocb *, struct iov_iter *);
+    __poll_t (*poll)(struct file *, poll_table *);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+    int (*mmap)(struct file *, struct vm_area_struct *);
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    int (*fasync)(int, struct file *, int);
+    ssize_t (*splice_write)(struct pipe_inode_info *, struct file *, loff_t *, size_t, unsigned int);
+    ssize_t (*splice_read)(struct file *, loff_t *, struct pipe_inode_info *, size_t, unsigned int);
+    int (*show)(struct seq_file *, void *); /* Harness only, the DEFINE_SHOW_ATTRIBUTE function */
+};
+
+static inline ssize_t copy_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe,
+        size_t len, unsigned int flags)
+{
+    return -EINVAL;
+}
+
+static inline ssize_t iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
+        loff_t *ppos, size_t len, unsigned int flags)
+{
+    return -EINVAL;
+}
+
+static inline void cdev_init(struct cdev *cdev, const struct file_operations *fops) { cdev->ops = fops; }
+static inline int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count)
+{
+    cdev->dev = dev;
+    return 0;
+}
+static inline void cdev_del(struct cdev *cdev) { }
+
+int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name);
+static inline void unregister_chrdev_region(dev_t from, unsigned int count) { }
+
+/* sysfs, the harness keeps the devices in a list so their attributes can be shown */
+struct attribute {
+    const char *name;
+    umode_t mode;
+};
+
+struct attribute_group {
+    const char *name;
+    struct attribute **attrs;
+};
+
+struct class {
+    const char *name;
+};
+
+struct device {
+    struct device *next;
+    dev_t devt;
+    void *driver_data;
+    const struct attribute_group **groups;
+};
+
+struct device_attribute {
+    struct attribute attr;
+    ssize_t (*show)(struct device *dev, struct device_attribute *attr, char *buf);
+};
+
+#define DEVICE_ATTR_RO(_name) \
+    struct device_attribute dev_attr_##_name = { .attr = { .name = #_name, .mode = 0444 }, .show = _name##_show }
+
+static inline void *dev_get_drvdata(const struct device *dev) { return dev->driver_data; }
+
+struct class *class_create(const char *name);
+static inline void class_destroy(struct class *cls) { }
+struct device *device_create_with_groups(struct class *cls, struct device *parent, dev_t devt,
+        void *drvdata, const struct attribute_group **groups, const char *fmt, ...);
+void device_destroy(struct class *cls, dev_t devt);
+struct device *kshim_device_find(dev_t devt);
+int sysfs_emit(char *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* debugfs and seq_file, the entries aren't created in the harness */
+struct dentry;
+
+struct seq_file {
+    FILE *out;
+    void *private;
+};
+
+#define seq_printf(s, fmt, ...) fprintf((s)->out, fmt, ##__VA_ARGS__)
+
+#define DEFINE_SHOW_ATTRIBUTE(__name) \
+static const struct file_operations __name##_fops = { \
+    .owner = THIS_MODULE, \
+    .show = __name##_show, \
+}
+
+static inline struct dentry *debugfs_create_dir(const char *name, struct dentry *parent) { return NULL; }
+static inline struct dentry *debugfs_create_file(const char *name, umode_t mode, struct dentry *parent,
+        void *data, const struct file_operations *fops)
+{
+    return NULL;
+}
+static inline void debugfs_remove_recursive(struct dentry *dentry) { }
+
+#endif /* AESD_CHAR_DRIVER_HARNESS_KSHIM_H_ */
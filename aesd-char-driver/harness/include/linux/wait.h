@@ -0,0 +1,2 @@
+/* Userspace harness stand-in, see kshim.h */
+#include <kshim.h>
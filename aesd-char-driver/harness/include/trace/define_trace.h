@@ -0,0 +1 @@
+/* Userspace harness stand-in, tracepoints are compiled out so nothing is defined here */
@@ -0,0 +1,158 @@
+/**
+ * @file kshim.c
+ * @brief Out of line parts of the userspace kernel shim in include/kshim.h
+ */
+#include <kshim.h>
+
+#define KSHIM_RCU_BATCH 1024 // kfree_rcu callbacks queued before a grace period is forced
+#define KSHIM_MAJOR 240 // first major reserved for local/experimental use
+
+static pthread_rwlock_t rcu_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t rcu_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_head *rcu_queue;
+static unsigned int rcu_queue_len;
+
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct device *devices;
+
+bool kshim_lock_hold_stats;
+
+void rcu_read_lock(void)
+{
+    pthread_rwlock_rdlock(&rcu_lock);
+}
+
+void rcu_read_unlock(void)
+{
+    pthread_rwlock_unlock(&rcu_lock);
+}
+
+/**
+ * Wait for every reader inside rcu_read_lock() when called to leave, then free @param list
+ */
+static void rcu_free_list(struct rcu_head *list)
+{
+    struct rcu_head *next;
+
+    pthread_rwlock_wrlock(&rcu_lock);
+    pthread_rwlock_unlock(&rcu_lock);
+
+    for (; list; list = next) {
+        next = list->next;
+        free(list->ptr);
+    }
+}
+
+void kshim_kfree_rcu(struct rcu_head *head, void *ptr)
+{
+    struct rcu_head *list = NULL;
+
+    head->ptr = ptr;
+    pthread_mutex_lock(&rcu_queue_lock);
+    head->next = rcu_queue;
+    rcu_queue = head;
+    if (++rcu_queue_len >= KSHIM_RCU_BATCH) {
+        list = rcu_queue;
+        rcu_queue = NULL;
+        rcu_queue_len = 0;
+    }
+    pthread_mutex_unlock(&rcu_queue_lock);
+
+    if (list)
+        rcu_free_list(list);
+}
+
+void rcu_barrier(void)
+{
+    struct rcu_head *list;
+
+    pthread_mutex_lock(&rcu_queue_lock);
+    list = rcu_queue;
+    rcu_queue = NULL;
+    rcu_queue_len = 0;
+    pthread_mutex_unlock(&rcu_queue_lock);
+
+    rcu_free_list(list);
+}
+
+int kshim_this_cpu(void)
+{
+    static int next_cpu;
+    static __thread int cpu = -1;
+
+    if (cpu < 0)
+        cpu = __atomic_fetch_add(&next_cpu, 1, __ATOMIC_RELAXED) % KSHIM_NR_CPUS;
+    return cpu;
+}
+
+int alloc_chrdev_region(dev_t *dev, unsigned int baseminor, unsigned int count, const char *name)
+{
+    *dev = MKDEV(KSHIM_MAJOR, baseminor);
+    return 0;
+}
+
+struct class *class_create(const char *name)
+{
+    static struct class cls;
+
+    cls.name = name;
+    return &cls;
+}
+
+struct device *device_create_with_groups(struct class *cls, struct device *parent, dev_t devt,
+        void *drvdata, const struct attribute_group **groups, const char *fmt, ...)
+{
+    struct device *device;
+
+    device = calloc(1, sizeof(*device));
+    if (!device)
+        return ERR_PTR(-ENOMEM);
+
+    device->devt = devt;
+    device->driver_data = drvdata;
+    device->groups = groups;
+
+    pthread_mutex_lock(&device_lock);
+    device->next = devices;
+    devices = device;
+    pthread_mutex_unlock(&device_lock);
+    return device;
+}
+
+void device_destroy(struct class *cls, dev_t devt)
+{
+    struct device **link;
+    struct device *device;
+
+    pthread_mutex_lock(&device_lock);
+    for (link = &devices; (device = *link); link = &device->next) {
+        if (device->devt == devt) {
+            *link = device->next;
+            free(device);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&device_lock);
+}
+
+struct device *kshim_device_find(dev_t devt)
+{
+    struct device *device;
+
+    pthread_mutex_lock(&device_lock);
+    for (device = devices; device && device->devt != devt; device = device->next)
+        ;
+    pthread_mutex_unlock(&device_lock);
+    return device;
+}
+
+int sysfs_emit(char *buf, const char *fmt, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(buf, PAGE_SIZE, fmt, args);
+    va_end(args);
+    return len;
+}
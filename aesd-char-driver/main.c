@@ -17,17 +17,106 @@
 #include <linux/types.h>
 #include <linux/cdev.h>
 #include <linux/fs.h> // file_operations
+#include <linux/uio.h> // iov_iter
+#include <linux/mm.h> // vm_area_struct
+#include <linux/vmalloc.h> // vmalloc_user
+#include <linux/version.h>
+#include <linux/device.h> // class_create
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/signal.h> // SIGIO for kill_fasync
+#include <linux/preempt.h>
 #include "aesdchar.h"
 #include "aesd-circular-buffer.h"
 #include "aesd_ioctl.h"
 
+#define CREATE_TRACE_POINTS
+#include "aesdchar_trace.h"
+
 int aesd_major =   0; // use dynamic major
 int aesd_minor =   0;
 
 MODULE_AUTHOR("Carlos Alvarado"); /** TODO: fill in your name **/
 MODULE_LICENSE("Dual BSD/GPL");
 
-struct aesd_dev aesd_device;
+bool aesd_tail_reads = false; // block reads at the end of the data until more is written
+module_param_named(tail_reads, aesd_tail_reads, bool, S_IRUGO);
+MODULE_PARM_DESC(tail_reads, "Block reads at end of data until a new command is written, unless O_NONBLOCK");
+
+unsigned long aesd_max_bytes = 0; // retention budget per device in bytes, 0 for no limit
+module_param_named(max_bytes, aesd_max_bytes, ulong, S_IRUGO);
+MODULE_PARM_DESC(max_bytes, "Evict the oldest commands to keep at most this many bytes per device, 0 for no limit");
+
+int aesd_max_entries = 0; // commands kept per device, 0 for AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+module_param_named(max_entries, aesd_max_entries, int, S_IRUGO);
+MODULE_PARM_DESC(max_entries, "Keep at most this many commands per device, 0 for the circular buffer size");
+
+int aesd_nr_devs = AESD_NR_DEVS; // number of /dev/aesdcharN instances
+module_param_named(nr_devs, aesd_nr_devs, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devs, "Number of aesdchar devices, each with its own circular buffer and lock");
+
+struct aesd_dev *aesd_devices; // allocated in aesd_init_module
+static struct class *aesd_class; // exposes the stats attributes in sysfs
+static struct dentry *aesd_debugfs_root;
+
+/**
+ * Take dev->lock, accounting the time spent waiting for it when it's contended
+ */
+static void aesd_lock(struct aesd_dev *dev)
+{
+    u64 start, wait_ns;
+
+    if (mutex_trylock(&dev->lock)) {
+        trace_aesd_lock_acquire(MINOR(dev->cdev.dev), 0);
+        return;
+    }
+
+    start = ktime_get_ns();
+    mutex_lock(&dev->lock);
+    wait_ns = ktime_get_ns() - start;
+    this_cpu_add(dev->stats->lock_wait_ns, wait_ns);
+    trace_aesd_lock_acquire(MINOR(dev->cdev.dev), wait_ns);
+}
+
+/**
+ * Interruptible version of aesd_lock()
+ * @return 0 when the lock is held, -ERESTARTSYS if interrupted by a signal
+ */
+static int aesd_lock_interruptible(struct aesd_dev *dev)
+{
+    u64 start, wait_ns;
+
+    if (mutex_trylock(&dev->lock)) {
+        trace_aesd_lock_acquire(MINOR(dev->cdev.dev), 0);
+        return 0;
+    }
+
+    start = ktime_get_ns();
+    if (mutex_lock_interruptible(&dev->lock))
+        return -ERESTARTSYS;
+    wait_ns = ktime_get_ns() - start;
+    this_cpu_add(dev->stats->lock_wait_ns, wait_ns);
+    trace_aesd_lock_acquire(MINOR(dev->cdev.dev), wait_ns);
+    return 0;
+}
+
+/**
+ * Release dev->lock taken with aesd_lock() or aesd_lock_interruptible()
+ */
+static void aesd_unlock(struct aesd_dev *dev)
+{
+    trace_aesd_lock_release(MINOR(dev->cdev.dev), aesd_circular_buffer_count(&dev->buffer));
+    mutex_unlock(&dev->lock);
+}
+
+/**
+ * @return the device the open file @param filp refers to
+ */
+static inline struct aesd_dev *aesd_file_dev(struct file *filp)
+{
+    return ((struct aesd_file *)filp->private_data)->dev;
+}
 
 int aesd_open(struct inode *inode, struct file *filp)
 {
@@ -36,15 +125,17 @@ int aesd_open(struct inode *inode, struct file *filp)
      * TODO: handle open
      */
 
-    struct aesd_dev *dev;
-
-    dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
-    filp->private_data = dev;
+    struct aesd_file *file;
 
-    if (!dev) {
-        return -EFAULT;
+    file = kzalloc(sizeof(struct aesd_file), GFP_KERNEL);
+    if (!file) {
+        return -ENOMEM;
     }
 
+    file->dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
+    mutex_init(&file->write_lock);
+    filp->private_data = file;
+
     return 0;
 
 }
@@ -56,147 +147,764 @@ int aesd_release(struct inode *inode, struct file *filp)
      * TODO: handle release
      */
 
-    struct aesd_dev *dev;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    size_t size;
+    size_t dropped;
+
+    // Hand an incomplete command to the next writer, as when all writers shared one buffer.
+    // The handoff buffer holds at most one command without its newline, if several closing
+    // writers leave more than that the excess is dropped, counted and warned about.
+    if (file->partial_write_size) {
+        aesd_lock(dev);
+        size = min(file->partial_write_size, AESDCHAR_MAX_WRITE_SIZE - 1 - dev->partial_write_size);
+        memcpy(dev->partial_write_buffer + dev->partial_write_size, file->partial_write_buffer, size);
+        WRITE_ONCE(dev->partial_write_size, dev->partial_write_size + size);
+        aesd_unlock(dev);
+
+        dropped = file->partial_write_size - size;
+        if (dropped) {
+            this_cpu_add(dev->stats->partial_bytes_dropped, dropped);
+            printk_ratelimited(KERN_WARNING "aesdchar%d: dropped %zu bytes of an incomplete command on close\n",
+                    MINOR(dev->cdev.dev), dropped);
+        }
+    }
 
-    dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
-    filp->private_data = dev;
+    // Stop SIGIO notifications to the closing file
+    aesd_fasync(-1, filp, 0);
 
+    kfree(file);
     return 0;
 }
 
-ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
-                loff_t *f_pos)
+/**
+ * Allocate an aesd_buffer_data holding @param size bytes with a single reference owned by
+ * the circular buffer.
+ * @return the location to use as the entry buffptr, or NULL on allocation failure
+ */
+static char *aesd_data_alloc(size_t size)
+{
+    struct aesd_buffer_data *data;
+
+    data = kmalloc(struct_size(data, data, size), GFP_KERNEL);
+    if (!data)
+        return NULL;
+
+    refcount_set(&data->refcount, 1);
+    return data->data;
+}
+
+/**
+ * Try to take a reference on the aesd_buffer_data backing @param buffptr, which must have been
+ * found under rcu_read_lock() still held by the caller.
+ * @return false if a writer already dropped the last reference
+ */
+static bool aesd_data_tryget(const char *buffptr)
+{
+    struct aesd_buffer_data *data = container_of(buffptr, struct aesd_buffer_data, data[0]);
+
+    return refcount_inc_not_zero(&data->refcount);
+}
+
+/**
+ * Drop a reference on the aesd_buffer_data backing @param buffptr, freeing it after an RCU
+ * grace period once the last reference is gone.
+ */
+static void aesd_data_put(const char *buffptr)
+{
+    struct aesd_buffer_data *data = container_of(buffptr, struct aesd_buffer_data, data[0]);
+
+    if (refcount_dec_and_test(&data->refcount))
+        kfree_rcu(data, rcu);
+}
+
+/**
+ * Describe up to @param count bytes of data from @param pos onwards in @param vec, without
+ * taking dev->lock.  The buffer descriptors are sampled under dev->seq and the data of every
+ * entry described is pinned with a reference taken under RCU, so a concurrent writer evicting
+ * an entry can't free it while the caller copies from it.
+ * @param pinned set to the referenced entry data behind each element of @param vec
+ * @param next_seq set to the sequence number of the next command at the time of the snapshot
+ * @param total_size set to the size of the stored data at the time of the snapshot
+ * @return the number of elements of @param vec filled, 0 if @param pos is past the end of the
+ *      buffer.  Release each element of @param pinned with aesd_data_put().
+ */
+static unsigned int aesd_get_data_vec(struct aesd_dev *dev, loff_t pos, size_t count,
+        struct kvec *vec, const char **pinned, u64 *next_seq, size_t *total_size)
+{
+    size_t entry_offset = 0;
+    unsigned int nr_vecs;
+    unsigned int seq;
+    unsigned int i;
+
+    rcu_read_lock();
+    for (;;) {
+        do {
+            seq = read_seqcount_begin(&dev->seq);
+            nr_vecs = aesd_circular_buffer_export_iovec(&dev->buffer, pos, count, vec,
+                    AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &entry_offset);
+            *next_seq = dev->next_seq;
+            *total_size = dev->buffer.total_size;
+        } while (read_seqcount_retry(&dev->seq, seq));
+
+        // Only the first element can start part way into its entry
+        for (i = 0; i < nr_vecs; i++) {
+            pinned[i] = (const char *)vec[i].iov_base - (i ? 0 : entry_offset);
+            if (!aesd_data_tryget(pinned[i]))
+                break;
+        }
+        if (i == nr_vecs)
+            break;
+
+        // A writer dropped the last reference on one since the snapshot, look again
+        while (i-- > 0)
+            aesd_data_put(pinned[i]);
+    }
+    rcu_read_unlock();
+
+    return nr_vecs;
+}
+
+/**
+ * Find the command numbered @param cmd_seq in O(1) without taking dev->lock, and take a
+ * reference on its data as aesd_get_data_vec() does.
+ * @param first_seq set to the sequence number of the oldest stored command
+ * @param next_seq set to the sequence number the next committed command will get
+ * @return the referenced entry data, or NULL if the command was evicted (@param cmd_seq is
+ *      below @param first_seq) or isn't written yet.  Release with aesd_data_put().
+ */
+static const char *aesd_get_data_for_seq(struct aesd_dev *dev, u64 cmd_seq, size_t *entry_size,
+        u64 *first_seq, u64 *next_seq)
+{
+    struct aesd_buffer_entry *entry;
+    const char *buffptr;
+    unsigned int seq;
+    unsigned int slot;
+
+    rcu_read_lock();
+    for (;;) {
+        do {
+            seq = read_seqcount_begin(&dev->seq);
+            buffptr = NULL;
+            *next_seq = dev->next_seq;
+            *first_seq = *next_seq - aesd_circular_buffer_count(&dev->buffer);
+            if (cmd_seq >= *first_seq && cmd_seq < *next_seq) {
+                // The distance is below the ring size, keep the modulo out of 64 bit math
+                slot = (dev->buffer.out_offs + (unsigned int)(cmd_seq - *first_seq)) %
+                        AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+                entry = &dev->buffer.entry[slot];
+                buffptr = entry->buffptr;
+                *entry_size = entry->size;
+            }
+        } while (read_seqcount_retry(&dev->seq, seq));
+
+        if (!buffptr || aesd_data_tryget(buffptr))
+            break;
+    }
+    rcu_read_unlock();
+
+    return buffptr;
+}
+
+/**
+ * @return true if there is data to read at @param pos, checked without taking dev->lock
+ */
+static bool aesd_data_ready(struct aesd_dev *dev, loff_t pos)
+{
+    size_t entry_offset;
+    unsigned int seq;
+    bool ready;
+
+    do {
+        seq = read_seqcount_begin(&dev->seq);
+        ready = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, pos, &entry_offset) != NULL;
+    } while (read_seqcount_retry(&dev->seq, seq));
+
+    return ready;
+}
+
+/**
+ * @return the sequence number the next committed command will get, read without dev->lock
+ */
+static u64 aesd_next_seq(struct aesd_dev *dev)
+{
+    unsigned int seq;
+    u64 next_seq;
+
+    do {
+        seq = read_seqcount_begin(&dev->seq);
+        next_seq = dev->next_seq;
+    } while (read_seqcount_retry(&dev->seq, seq));
+
+    return next_seq;
+}
+
+/**
+ * @return true if @param pos is where the last read through the file position of @param file
+ * stopped at the end of the data
+ */
+static bool aesd_file_at_end(struct aesd_file *file, loff_t pos)
+{
+    return READ_ONCE(file->at_end) && READ_ONCE(file->end_pos) == pos;
+}
+
+/**
+ * @return true if a read at @param pos would return data.  Once a read through the file
+ * position of @param file reached the end of the data that is whenever a command was written
+ * since, because the end moves or stays put as the new commands evict the oldest and
+ * @param pos can no longer locate it.
+ * @param file the file whose position @param pos is, or NULL for an explicit offset
+ */
+static bool aesd_file_ready(struct aesd_dev *dev, struct aesd_file *file, loff_t pos)
+{
+    if (file && aesd_file_at_end(file, pos))
+        return aesd_next_seq(dev) != READ_ONCE(file->end_seq);
+    return aesd_data_ready(dev, pos);
+}
+
+/**
+ * @return true if @param iocb reads at the file position, as read() does, rather than at an
+ * offset of its own as pread() does.  The VFS passes both as a copy of the position, so a
+ * pread() at exactly the file position can't be told apart and is treated as a read().
+ */
+static bool aesd_reads_fpos(struct kiocb *iocb)
+{
+    return iocb->ki_pos == READ_ONCE(iocb->ki_filp->f_pos);
+}
+
+/**
+ * Set the file position of @param filp to @param pos, counted from the oldest stored command
+ */
+static void aesd_set_fpos(struct file *filp, loff_t pos)
+{
+    struct aesd_file *file = filp->private_data;
+
+    filp->f_pos = pos;
+    WRITE_ONCE(file->at_end, false);
+}
+
+/**
+ * Copy data starting at @param pos to @param to, continuing across consecutive entries until
+ * @param to is full or the data runs out.  @param pos is advanced by the number of bytes copied.
+ * Readers never wait on dev->lock.
+ * @param file if not NULL, the file whose position @param pos is, which records whether the copy
+ *      reached the end of the data for aesd_file_ready()
+ * @return the number of bytes copied, 0 at end of data, or -EFAULT if nothing could be copied
+ */
+static ssize_t aesd_copy_from_fpos(struct aesd_dev *dev, loff_t *pos, struct iov_iter *to,
+        struct aesd_file *file)
+{
+    struct kvec vec[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    const char *pinned[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    size_t count = iov_iter_count(to);
+    size_t bytes_read = 0;
+    size_t total_read = 0;
+    size_t copied = 0;
+    size_t total_size;
+    u64 next_seq;
+    unsigned int nr_vecs;
+    unsigned int i;
+
+    // Nothing to copy, and a max_bytes of 0 would mean no limit to the export below
+    if (count == 0) {
+        return 0;
+    }
+
+    // One snapshot describes every entry needed to fill to, rather than a search per entry
+    nr_vecs = aesd_get_data_vec(dev, *pos, count, vec, pinned, &next_seq, &total_size);
+
+    for (i = 0; i < nr_vecs; i++) {
+        bytes_read = vec[i].iov_len;
+        copied = copy_to_iter(vec[i].iov_base, bytes_read, to);
+        total_read += copied;
+        if (copied < bytes_read) {
+            break;
+        }
+    }
+
+    for (i = 0; i < nr_vecs; i++) {
+        aesd_data_put(pinned[i]);
+    }
+
+    // Report the fault only if nothing could be copied at all
+    if (copied < bytes_read && total_read == 0) {
+        return -EFAULT;
+    }
+
+    *pos += total_read;
+    if (file) {
+        WRITE_ONCE(file->end_seq, next_seq);
+        WRITE_ONCE(file->end_pos, *pos);
+        WRITE_ONCE(file->at_end, *pos >= total_size);
+    }
+    return total_read;
+}
+
+/**
+ * Translate the zero referenced command @param write_cmd, counted from the oldest stored
+ * command, and @param write_cmd_offset within it into a file position, without dev->lock.
+ * @return 0 with @param pos set, or -EINVAL if the command or offset isn't stored
+ */
+static int aesd_cmd_to_fpos(struct aesd_dev *dev, uint32_t write_cmd, uint32_t write_cmd_offset,
+        loff_t *pos)
+{
+    struct aesd_buffer_entry *entry;
+    unsigned int seq;
+    loff_t total_size;
+    uint8_t slot;
+    uint32_t i;
+    int retval;
+
+    do {
+        seq = read_seqcount_begin(&dev->seq);
+        retval = -EINVAL;
+        total_size = 0;
+        slot = dev->buffer.out_offs;
+        if (write_cmd < aesd_circular_buffer_count(&dev->buffer)) {
+            for (i = 0; i < write_cmd; i++) {
+                total_size += dev->buffer.entry[slot].size;
+                slot = (slot + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+            }
+            entry = &dev->buffer.entry[slot];
+            if (write_cmd_offset < entry->size) {
+                *pos = total_size + write_cmd_offset;
+                retval = 0;
+            }
+        }
+    } while (read_seqcount_retry(&dev->seq, seq));
+
+    return retval;
+}
+
+/**
+ * Translate the command numbered @param cmd_seq and @param seq_offset within it into a file
+ * position, without dev->lock.  @param cmd_seq may be the next sequence number with a zero
+ * offset, giving the end of the data.
+ * @param first_seq and @param next_seq set as for aesd_get_data_for_seq()
+ * @return 0 with @param pos set, -ESTALE if the command was evicted, or -EINVAL if the
+ *      command isn't written yet or the offset is outside it
+ */
+static int aesd_seq_to_fpos(struct aesd_dev *dev, u64 cmd_seq, uint32_t seq_offset, loff_t *pos,
+        u64 *first_seq, u64 *next_seq)
+{
+    unsigned int seq;
+    unsigned int count;
+    unsigned int i;
+    loff_t total_size;
+    uint8_t slot;
+    int retval;
+
+    do {
+        seq = read_seqcount_begin(&dev->seq);
+        count = aesd_circular_buffer_count(&dev->buffer);
+        *next_seq = dev->next_seq;
+        *first_seq = *next_seq - count;
+        total_size = 0;
+        slot = dev->buffer.out_offs;
+
+        if (cmd_seq < *first_seq) {
+            retval = -ESTALE;
+        } else if (cmd_seq > *next_seq) {
+            retval = -EINVAL;
+        } else {
+            // Sum the commands before cmd_seq, then check the offset against cmd_seq itself
+            for (i = 0; i < (unsigned int)(cmd_seq - *first_seq); i++) {
+                total_size += dev->buffer.entry[slot].size;
+                slot = (slot + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+            }
+            if (cmd_seq == *next_seq ? seq_offset == 0 : seq_offset < dev->buffer.entry[slot].size) {
+                *pos = total_size + seq_offset;
+                retval = 0;
+            } else {
+                retval = -EINVAL;
+            }
+        }
+    } while (read_seqcount_retry(&dev->seq, seq));
+
+    return retval;
+}
+
+ssize_t aesd_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
     ssize_t retval = 0;
+    struct file *filp = iocb->ki_filp;
+    loff_t *f_pos = &iocb->ki_pos;
+    size_t count = iov_iter_count(to);
     PDEBUG("read %zu bytes with offset %lld",count,*f_pos);
     /**
      * TODO: handle read
      */
 
-    struct aesd_dev *dev = filp->private_data;
-    size_t entry_offset = 0;
-    size_t bytes_read = 0;
-    struct aesd_buffer_entry *entry;
+    struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
+    struct aesd_file *file = NULL;
+    size_t total_read = 0;
+    u64 first_seq, next_seq;
 
-    if (mutex_lock_interruptible(&dev->lock))
-        return -ERESTARTSYS;
+    // Only reads through the file position follow it by sequence number, a pread() reads the
+    // offset it asks for and leaves the file's tail state alone
+    if (aesd_reads_fpos(iocb)) {
+        file = filp->private_data;
+    }
 
-    // Find the entry and offset for the file position
-    entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, *f_pos, &entry_offset);
-    if (entry) {
-        bytes_read = min(count, entry->size - entry_offset);
-        if (copy_to_user(buf, entry->buffptr + entry_offset, bytes_read)) {
-            retval = -EFAULT;
+    trace_aesd_read_enter(MINOR(dev->cdev.dev), count, *f_pos, aesd_circular_buffer_count(&dev->buffer));
+
+    // In tail mode wait for the next command instead of returning EOF, unless there's no room for it
+    if (aesd_tail_reads && count && !aesd_file_ready(dev, file, *f_pos)) {
+        if ((filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT)) {
+            retval = -EAGAIN;
+            goto out;
+        }
+        if (wait_event_interruptible(dev->read_queue, aesd_file_ready(dev, file, *f_pos))) {
+            retval = -ERESTARTSYS;
             goto out;
-        } else {
-            *f_pos += bytes_read;
-            retval = bytes_read;
         }
-    } else {
-        retval = 0;  // Return 0 to indicate EOF
     }
 
+    // Resume at the first command written since the last read reached the end of the data,
+    // or at the oldest if that was evicted too
+    if (file && aesd_file_at_end(file, *f_pos) &&
+            aesd_seq_to_fpos(dev, file->end_seq, 0, f_pos, &first_seq, &next_seq) == -ESTALE) {
+        *f_pos = 0;
+    }
+
+    // Keep copying from consecutive entries until the user buffer is full or we run out of data
+    retval = aesd_copy_from_fpos(dev, f_pos, to, file);
+    if (retval > 0) {
+        total_read = retval;
+    }
+
+    this_cpu_inc(dev->stats->reads);
+    this_cpu_add(dev->stats->bytes_read, total_read);
+
 out:
-    mutex_unlock(&dev->lock);
+    trace_aesd_read_exit(MINOR(dev->cdev.dev), retval, *f_pos, aesd_circular_buffer_count(&dev->buffer));
     return retval;
 
 }
 
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
-                loff_t *f_pos)
+/**
+ * Take a snapshot of the stored entries of @param dev for aesd_mmap_publish(), without
+ * dev->lock.  Must be called with dev->mmap_lock held.
+ * @param slots set to the circular buffer slot of each entry, oldest first
+ * @param pinned set to the data of each entry whose slot of the mmap area doesn't hold it yet,
+ *      with a reference taken as aesd_get_data_vec() does, or NULL.  Release with aesd_data_put().
+ * @param sizes set to the size of each entry
+ * @param next_seq set to the sequence number the next committed command will get
+ * @return the number of entries
+ */
+static unsigned int aesd_mmap_snapshot(struct aesd_dev *dev, uint8_t *slots, const char **pinned,
+        size_t *sizes, u64 *next_seq)
+{
+    struct aesd_buffer_entry *entry;
+    unsigned int count;
+    unsigned int seq;
+    unsigned int i;
+    u64 first_seq;
+
+    rcu_read_lock();
+    for (;;) {
+        do {
+            seq = read_seqcount_begin(&dev->seq);
+            *next_seq = dev->next_seq;
+            count = aesd_circular_buffer_count(&dev->buffer);
+            first_seq = *next_seq - count;
+            for (i = 0; i < count; i++) {
+                slots[i] = (dev->buffer.out_offs + i) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+                entry = &dev->buffer.entry[slots[i]];
+                pinned[i] = dev->mmap_slot_seq[slots[i]] == first_seq + i + 1 ? NULL : entry->buffptr;
+                sizes[i] = entry->size;
+            }
+        } while (read_seqcount_retry(&dev->seq, seq));
+
+        for (i = 0; i < count; i++) {
+            if (pinned[i] && !aesd_data_tryget(pinned[i]))
+                break;
+        }
+        if (i == count)
+            break;
+
+        // A writer dropped the last reference on one since the snapshot, look again
+        while (i-- > 0) {
+            if (pinned[i])
+                aesd_data_put(pinned[i]);
+        }
+    }
+    rcu_read_unlock();
+
+    return count;
+}
+
+/**
+ * Bring the mmap area of @param dev up to date with the circular buffer, once the command
+ * numbered @param seq - 1 is committed.  Only slots holding a command they didn't hold at the
+ * last update are copied, and the descriptors are republished in oldest to newest order.
+ * Runs under dev->mmap_lock rather than dev->lock, so commits and readers don't wait for the
+ * copy.  When another writer's update already covered the command there is nothing to do.
+ */
+static void aesd_mmap_publish(struct aesd_dev *dev, u64 seq)
+{
+    struct aesd_mmap_header *header = dev->mmap_header;
+    char *data_area = (char *)header + AESD_MMAP_DATA_OFFSET;
+    uint8_t slots[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    const char *pinned[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    size_t sizes[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    uint32_t generation;
+    unsigned int count;
+    u64 first_seq;
+    u64 next_seq;
+    unsigned int i;
+
+    mutex_lock(&dev->mmap_lock);
+    if (dev->mmap_seq >= seq) {
+        goto out;
+    }
+
+    count = aesd_mmap_snapshot(dev, slots, pinned, sizes, &next_seq);
+    first_seq = next_seq - count;
+
+    generation = header->generation;
+    WRITE_ONCE(header->generation, generation + 1);
+    smp_wmb();
+
+    for (i = 0; i < count; i++) {
+        if (pinned[i]) {
+            memcpy(data_area + slots[i] * AESD_MMAP_SLOT_SIZE, pinned[i], sizes[i]);
+            dev->mmap_slot_seq[slots[i]] = first_seq + i + 1;
+            aesd_data_put(pinned[i]);
+        }
+        header->entry[i].offset = AESD_MMAP_DATA_OFFSET + slots[i] * AESD_MMAP_SLOT_SIZE;
+        header->entry[i].size = sizes[i];
+    }
+
+    header->count = count;
+    header->total_commands = next_seq;
+
+    smp_wmb();
+    WRITE_ONCE(header->generation, generation + 2);
+    dev->mmap_seq = next_seq;
+out:
+    mutex_unlock(&dev->mmap_lock);
+}
+
+/**
+ * Add the complete command in @param buf to the circular buffer of @param dev.  The entry is
+ * allocated and filled before dev->lock is taken, and the evicted entries are released and
+ * the mmap area updated after it is dropped, so the critical section only publishes the
+ * prepared entry.
+ */
+static int aesd_commit_entry(struct aesd_dev *dev, const char *buf, size_t size)
+{
+    struct aesd_buffer_entry entry;
+    struct aesd_buffer_entry removed;
+    const char *evicted[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    unsigned int nr_evicted = 0;
+    unsigned int i;
+    char *buffptr;
+    u64 seq;
+
+    // Allocate and fill the entry while other writers and readers keep going
+    buffptr = aesd_data_alloc(size);
+    if (!buffptr) {
+        return -ENOMEM;
+    }
+    memcpy(buffptr, buf, size);
+    entry.buffptr = buffptr;
+    entry.size = size;
+
+    // Not interruptible, earlier commands from the same write are already visible
+    aesd_lock(dev);
+
+    // Stamped under the lock so entries are in time order for AESDCHAR_IOCSEEKTIME
+    entry.timestamp_ns = ktime_get_ns();
+
+    // A plain seqcount_t, so readers spin rather than sleep on dev->lock while the sequence is
+    // odd, even on PREEMPT_RT.  Keep the writer on the CPU until it's even again.
+    preempt_disable();
+    write_seqcount_begin(&dev->seq);
+
+    // Drop the oldest entries until the new one fits the byte and entry budgets
+    while (aesd_circular_buffer_needs_eviction(&dev->buffer, size) &&
+            aesd_circular_buffer_remove_oldest(&dev->buffer, &removed)) {
+        evicted[nr_evicted++] = removed.buffptr;
+    }
+
+    // If circular buffer is still full, the oldest entry is overwritten by the add
+    if (aesd_circular_buffer_add_entry_evict(&dev->buffer, &entry, &removed)) {
+        evicted[nr_evicted++] = removed.buffptr;
+    }
+    seq = ++dev->next_seq;
+    write_seqcount_end(&dev->seq);
+    preempt_enable();
+
+    aesd_unlock(dev);
+
+    // Copy the command into the mmap area outside dev->lock
+    aesd_mmap_publish(dev, seq);
+
+    // Drop the references on the old buffers now they're unpublished
+    this_cpu_inc(dev->stats->commands_written);
+    this_cpu_add(dev->stats->evictions, nr_evicted);
+    for (i = 0; i < nr_evicted; i++) {
+        aesd_data_put(evicted[i]); // Readers still copying from it keep it alive
+    }
+
+    return 0;
+}
+
+/**
+ * Move an incomplete command left behind by a writer which closed @param file's device into
+ * the empty staging buffer of @param file.
+ */
+static void aesd_adopt_partial_write(struct aesd_file *file)
+{
+    struct aesd_dev *dev = file->dev;
+
+    aesd_lock(dev);
+    memcpy(file->partial_write_buffer, dev->partial_write_buffer, dev->partial_write_size);
+    file->partial_write_size = dev->partial_write_size;
+    WRITE_ONCE(dev->partial_write_size, 0);
+    aesd_unlock(dev);
+}
+
+ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
     ssize_t retval = -ENOMEM;
-    PDEBUG("write %zu bytes with offset %lld",count,*f_pos);
+    struct file *filp = iocb->ki_filp;
+    size_t count = iov_iter_count(from);
+    PDEBUG("write %zu bytes with offset %lld",count,iocb->ki_pos);
     /**
      * TODO: handle write
      */
 
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
     char *kbuf;
-    struct aesd_buffer_entry entry;
+    const char *newline;
+    size_t chunk;
     int newline_found = 0;
-    size_t i;
+    size_t i = 0;
 
     if (!dev) {
         return -EFAULT;
     }
 
+    trace_aesd_write_enter(MINOR(dev->cdev.dev), count, iocb->ki_pos, aesd_circular_buffer_count(&dev->buffer));
+
     kbuf = kmalloc(count, GFP_KERNEL);
     if (!kbuf) {
-        return retval;
+        goto out;
     }
 
-    if (copy_from_user(kbuf, buf, count)) {
+    if (!copy_from_iter_full(kbuf, count, from)) {
         retval = -EFAULT;
         goto out;
     }
 
-    if (mutex_lock_interruptible(&dev->lock)) {
+    if (mutex_lock_interruptible(&file->write_lock)) {
         retval = -ERESTARTSYS;
         goto out;
     }
 
-    for (i = 0; i < count; i++) {
-        dev->partial_write_buffer[dev->partial_write_size++] = kbuf[i];
+    // Pick up an incomplete command left behind by a writer which closed the device
+    if (file->partial_write_size == 0 && READ_ONCE(dev->partial_write_size)) {
+        aesd_adopt_partial_write(file);
+    }
 
-        if (kbuf[i] == '\n') {
-            newline_found = 1;
+    while (i < count) {
+        newline = memchr(kbuf + i, '\n', count - i);
+        chunk = newline ? newline - (kbuf + i) + 1 : count - i;
 
-            // Allocate buffer for the entry
-            entry.buffptr = kmalloc(dev->partial_write_size, GFP_KERNEL);
-            if (!entry.buffptr) {
-                retval = -ENOMEM;
-                goto unlock_out;
-            }
+        // Check for write size overflow, a command of the maximum size must end in a newline
+        if (file->partial_write_size + chunk > AESDCHAR_MAX_WRITE_SIZE ||
+                (!newline && file->partial_write_size + chunk == AESDCHAR_MAX_WRITE_SIZE)) {
+            retval = -ENOMEM;
+            goto unlock_out;
+        }
 
-            // Copy the contents of partial write buffer to the circular buffer entry
-            memcpy((void *)entry.buffptr, dev->partial_write_buffer, dev->partial_write_size);
-            entry.size = dev->partial_write_size;
+        memcpy(file->partial_write_buffer + file->partial_write_size, kbuf + i, chunk);
+        file->partial_write_size += chunk;
+        i += chunk;
 
-            // If circular buffer is full, free the old buffer
-            if (dev->buffer.full) {
-                kfree(dev->buffer.entry[dev->buffer.out_offs].buffptr); // Free old entry if buffer is full
+        if (newline) {
+            retval = aesd_commit_entry(dev, file->partial_write_buffer, file->partial_write_size);
+            if (retval) {
+                goto unlock_out;
             }
-
-            aesd_circular_buffer_add_entry(&dev->buffer, &entry);
-
-            dev->partial_write_size = 0; // Reset partial write size after adding to buffer
-        }
-
-        // Check for write size overflow
-        if (dev->partial_write_size >= AESDCHAR_MAX_WRITE_SIZE) {
-            retval = -ENOMEM;
-            goto unlock_out;
+            newline_found = 1;
+            file->partial_write_size = 0; // Reset partial write size after adding to buffer
         }
     }
 
     retval = count;
+    this_cpu_add(dev->stats->bytes_written, count);
 
     unlock_out:
-        mutex_unlock(&dev->lock);
+        mutex_unlock(&file->write_lock);
+
+        // Let blocked readers, pollers and SIGIO consumers know a complete command is available
+        if (newline_found) {
+            wake_up_interruptible(&dev->read_queue);
+            kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+        }
 
     out:
         kfree(kbuf);
+    trace_aesd_write_exit(MINOR(dev->cdev.dev), retval, iocb->ki_pos, aesd_circular_buffer_count(&dev->buffer));
     return retval;
 
 }
 
-loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
+__poll_t aesd_poll(struct file *filp, poll_table *wait)
 {
-    PDEBUG("llseek");
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM; // Writes never wait for space, old entries are overwritten
+
+    poll_wait(filp, &dev->read_queue, wait);
+
+    if (aesd_file_ready(dev, filp->private_data, filp->f_pos)) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+
+    return mask;
+}
+
+/**
+ * Add or remove @param filp from the processes sent SIGIO when a complete command is written,
+ * as requested with fcntl(F_SETFL, O_ASYNC)
+ */
+int aesd_fasync(int fd, struct file *filp, int mode)
+{
+    return fasync_helper(fd, filp, mode, &aesd_file_dev(filp)->async_queue);
+}
+
+int aesd_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+
+    // The history is read-only, refuse writable mappings now and through mprotect later
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    return remap_vmalloc_range(vma, dev->mmap_header, vma->vm_pgoff);
+}
+
+static loff_t aesd_do_llseek(struct file *filp, loff_t offset, int whence)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
     loff_t new_pos;
-    size_t total_size = 0;
-    size_t i;
+    size_t total_size;
 
     // Check for invalid file position
-    if (mutex_lock_interruptible(&dev->lock))
+    if (aesd_lock_interruptible(dev))
         return -ERESTARTSYS;
 
-    // Calculate total size of the circular buffer
-    for (i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; i++) {
-        total_size += dev->buffer.entry[i].size;
-    }
+    // Total size of the circular buffer is kept up to date on every add and remove
+    total_size = dev->buffer.total_size;
 
     // Check for invalid whence
     switch (whence) {
@@ -210,117 +918,613 @@ loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
         new_pos = total_size + offset;
         break;
     default:
-        mutex_unlock(&dev->lock);
+        aesd_unlock(dev);
         return -EINVAL;
     }
 
     // Check for invalid new position
     if (new_pos < 0 || new_pos > total_size) {
-        mutex_unlock(&dev->lock);
+        aesd_unlock(dev);
         return -EINVAL;
     }
 
     // Update file position
-    filp->f_pos = new_pos;
-    mutex_unlock(&dev->lock);
+    aesd_set_fpos(filp, new_pos);
+    aesd_unlock(dev);
     return new_pos;
 }
 
-long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+static long aesd_ioctl_seekto(struct file *filp, unsigned long arg)
 {
-    PDEBUG("ioctl");
-    struct aesd_dev *dev = filp->private_data;
+    struct aesd_dev *dev = aesd_file_dev(filp);
     struct aesd_seekto seekto;
+    loff_t pos;
+    int retval;
+
+    if (copy_from_user(&seekto, (struct aesd_seekto __user *)arg, sizeof(seekto)))
+        return -EFAULT;
+
+    // Check for invalid write command and write command offset
+    retval = aesd_cmd_to_fpos(dev, seekto.write_cmd, seekto.write_cmd_offset, &pos);
+    if (retval)
+        return retval;
+
+    // Update file position
+    aesd_set_fpos(filp, pos);
+    this_cpu_inc(dev->stats->seeks);
+    return 0;
+}
+
+/**
+ * Copy data starting at the command and offset in the struct aesd_pread at @param arg into
+ * its user buffer, like AESDCHAR_IOCSEEKTO followed by read but without using or changing
+ * the file position, so threads sharing a file can read concurrently.
+ * @return the number of bytes copied, 0 if no data follows the position
+ */
+static long aesd_ioctl_pread(struct file *filp, unsigned long arg)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_pread pread;
+    struct iov_iter iter;
+    ssize_t retval;
+    loff_t pos;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+    struct iovec iov;
+#endif
+
+    if (copy_from_user(&pread, (struct aesd_pread __user *)arg, sizeof(pread)))
+        return -EFAULT;
+
+    retval = aesd_cmd_to_fpos(dev, pread.write_cmd, pread.write_cmd_offset, &pos);
+    if (retval)
+        return retval;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    retval = import_ubuf(ITER_DEST, u64_to_user_ptr(pread.buf), min_t(u64, pread.len, MAX_RW_COUNT), &iter);
+#else
+    retval = import_single_range(READ, u64_to_user_ptr(pread.buf), min_t(u64, pread.len, MAX_RW_COUNT), &iov, &iter);
+#endif
+    if (retval)
+        return retval;
+
+    retval = aesd_copy_from_fpos(dev, &pos, &iter, NULL);
+    if (retval > 0) {
+        this_cpu_inc(dev->stats->reads);
+        this_cpu_add(dev->stats->bytes_read, retval);
+    }
+    return retval;
+}
+
+/**
+ * Fill the user array described by the struct aesd_index at @param arg with the logical index,
+ * size, file offset and sequence number of every stored command, oldest first, in one call.
+ * The snapshot is taken without dev->lock.
+ */
+static long aesd_ioctl_getindex(struct file *filp, unsigned long arg)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_index_entry entries[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    struct aesd_index index;
     struct aesd_buffer_entry *entry;
-    size_t total_size = 0;
-    size_t i;
+    uint64_t offset;
+    uint64_t first_seq;
+    unsigned int seq;
+    uint8_t count;
+    uint8_t i;
 
-    // Check for invalid ioctl command
-    if (_IOC_TYPE(cmd) != AESD_IOC_MAGIC || _IOC_NR(cmd) > AESDCHAR_IOC_MAXNR)
-        return -ENOTTY;
+    if (copy_from_user(&index, (struct aesd_index __user *)arg, sizeof(index)))
+        return -EFAULT;
 
-    if (copy_from_user(&seekto, (struct aesd_seekto __user *)arg, sizeof(seekto)))
+    do {
+        seq = read_seqcount_begin(&dev->seq);
+        count = aesd_circular_buffer_count(&dev->buffer);
+        first_seq = dev->next_seq - count;
+        offset = 0;
+        AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry, &dev->buffer, i) {
+            entries[i].write_cmd = i;
+            entries[i].size = entry->size;
+            entries[i].offset = offset;
+            entries[i].seq = first_seq + i;
+            entries[i].timestamp_ns = entry->timestamp_ns;
+            offset += entry->size;
+        }
+    } while (read_seqcount_retry(&dev->seq, seq));
+
+    // Copy as many as fit, count tells the caller how many there were
+    if (copy_to_user(u64_to_user_ptr(index.entries), entries,
+            min_t(uint32_t, index.count, count) * sizeof(struct aesd_index_entry)))
         return -EFAULT;
 
-    if (mutex_lock_interruptible(&dev->lock))
-        return -ERESTARTSYS;
+    index.count = count;
+    if (copy_to_user((struct aesd_index __user *)arg, &index, sizeof(index)))
+        return -EFAULT;
 
-    // Check for invalid write command
-    if (seekto.write_cmd >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED ||
-        dev->buffer.entry[seekto.write_cmd].buffptr == NULL) {
-        mutex_unlock(&dev->lock);
-        return -EINVAL;
+    return 0;
+}
+
+/**
+ * Set the file position to the command and offset given by sequence number in the
+ * struct aesd_seqread at @param arg, and report the range of stored sequence numbers in it.
+ * @return 0 on success, -ESTALE if the command was already evicted
+ */
+static long aesd_ioctl_seekseq(struct file *filp, unsigned long arg)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_seqread seqread;
+    loff_t pos;
+    u64 first_seq, next_seq;
+    long retval;
+
+    if (copy_from_user(&seqread, (struct aesd_seqread __user *)arg, sizeof(seqread)))
+        return -EFAULT;
+
+    retval = aesd_seq_to_fpos(dev, seqread.seq, seqread.seq_offset, &pos, &first_seq, &next_seq);
+    if (!retval) {
+        aesd_set_fpos(filp, pos);
+        this_cpu_inc(dev->stats->seeks);
+    }
+
+    // Report the stored range even on failure so an evicted reader can resume at first_seq
+    seqread.first_seq = first_seq;
+    seqread.next_seq = next_seq;
+    if (copy_to_user((struct aesd_seqread __user *)arg, &seqread, sizeof(seqread)))
+        return -EFAULT;
+
+    return retval;
+}
+
+/**
+ * Copy data starting at the command and offset given by sequence number in the
+ * struct aesd_seqread at @param arg into its user buffer, continuing across following commands,
+ * without using the file position.  seq and seq_offset are advanced past the copied data so
+ * the next call resumes exactly where this one stopped.
+ * @return the number of bytes copied, 0 if no data was written after the position yet, or
+ *      -ESTALE if the first command was already evicted
+ */
+static long aesd_ioctl_readseq(struct file *filp, unsigned long arg)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_seqread seqread;
+    struct iov_iter iter;
+    const char *buffptr;
+    size_t entry_size = 0;
+    size_t bytes_read;
+    size_t copied;
+    size_t total_read = 0;
+    u64 first_seq, next_seq;
+    long retval = 0;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+    struct iovec iov;
+#endif
+
+    if (copy_from_user(&seqread, (struct aesd_seqread __user *)arg, sizeof(seqread)))
+        return -EFAULT;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    retval = import_ubuf(ITER_DEST, u64_to_user_ptr(seqread.buf), min_t(u64, seqread.len, MAX_RW_COUNT), &iter);
+#else
+    retval = import_single_range(READ, u64_to_user_ptr(seqread.buf), min_t(u64, seqread.len, MAX_RW_COUNT), &iov, &iter);
+#endif
+    if (retval)
+        return retval;
+
+    do {
+        buffptr = aesd_get_data_for_seq(dev, seqread.seq, &entry_size, &first_seq, &next_seq);
+        if (!buffptr) {
+            // Evicted or beyond the newest command, only an error for the first command.  As
+            // for AESDCHAR_IOCSEEKSEQ the next command is the end of the data at offset 0 only.
+            if (total_read == 0 && seqread.seq < first_seq) {
+                retval = -ESTALE;
+            } else if (total_read == 0 && (seqread.seq > next_seq || seqread.seq_offset != 0)) {
+                retval = -EINVAL;
+            }
+            break;
         }
 
-    entry = &dev->buffer.entry[seekto.write_cmd];
+        if (seqread.seq_offset >= entry_size) {
+            aesd_data_put(buffptr);
+            retval = -EINVAL;   // Only possible for the first command
+            break;
+        }
 
-    // Check for invalid write command offset
-    if (seekto.write_cmd_offset >= entry->size) {
-        mutex_unlock(&dev->lock);
-        return -EINVAL;
+        bytes_read = min(iov_iter_count(&iter), entry_size - seqread.seq_offset);
+        copied = copy_to_iter(buffptr + seqread.seq_offset, bytes_read, &iter);
+        aesd_data_put(buffptr);
+
+        total_read += copied;
+        seqread.seq_offset += copied;
+        if (seqread.seq_offset == entry_size) {
+            seqread.seq++;
+            seqread.seq_offset = 0;
+        }
+
+        if (copied < bytes_read) {
+            // Report the fault only if nothing could be copied at all
+            if (total_read == 0) {
+                retval = -EFAULT;
+            }
+            break;
+        }
+    } while (iov_iter_count(&iter));
+
+    seqread.first_seq = first_seq;
+    seqread.next_seq = next_seq;
+    if (copy_to_user((struct aesd_seqread __user *)arg, &seqread, sizeof(seqread)))
+        return -EFAULT;
+
+    if (retval)
+        return retval;
+
+    this_cpu_inc(dev->stats->reads);
+    this_cpu_add(dev->stats->bytes_read, total_read);
+    return total_read;
+}
+
+/**
+ * Set the file position to the first command committed at or after the time in the
+ * struct aesd_seektime at @param arg, found by binary search over the entry timestamps, and
+ * report the command found in it.  Seeks to the end of the data if every command is older.
+ */
+static long aesd_ioctl_seektime(struct file *filp, unsigned long arg)
+{
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_seektime seektime;
+    unsigned int seq;
+    unsigned int count;
+    unsigned int low, high, mid;
+    unsigned int i;
+    uint64_t offset;
+    uint8_t slot;
+
+    if (copy_from_user(&seektime, (struct aesd_seektime __user *)arg, sizeof(seektime)))
+        return -EFAULT;
+
+    do {
+        seq = read_seqcount_begin(&dev->seq);
+        count = aesd_circular_buffer_count(&dev->buffer);
+
+        // Find the first logical index with timestamp_ns >= the requested time
+        low = 0;
+        high = count;
+        while (low < high) {
+            mid = (low + high) / 2;
+            slot = (dev->buffer.out_offs + mid) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+            if (dev->buffer.entry[slot].timestamp_ns < seektime.timestamp_ns)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        // The file position is the size of the commands before it, descriptors only
+        offset = 0;
+        slot = dev->buffer.out_offs;
+        for (i = 0; i < low; i++) {
+            offset += dev->buffer.entry[slot].size;
+            slot = (slot + 1) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        }
+
+        seektime.write_cmd = low;
+        seektime.seq = dev->next_seq - count + low;
+        seektime.offset = offset;
+    } while (read_seqcount_retry(&dev->seq, seq));
+
+    aesd_set_fpos(filp, offset);
+    this_cpu_inc(dev->stats->seeks);
+
+    if (copy_to_user((struct aesd_seektime __user *)arg, &seektime, sizeof(seektime)))
+        return -EFAULT;
+
+    return 0;
+}
+
+static long aesd_do_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    // Check for invalid ioctl command
+    if (_IOC_TYPE(cmd) != AESD_IOC_MAGIC || _IOC_NR(cmd) > AESDCHAR_IOC_MAXNR)
+        return -ENOTTY;
+
+    switch (cmd) {
+    case AESDCHAR_IOCSEEKTO:
+        return aesd_ioctl_seekto(filp, arg);
+    case AESDCHAR_IOCGETINDEX:
+        return aesd_ioctl_getindex(filp, arg);
+    case AESDCHAR_IOCPREAD:
+        return aesd_ioctl_pread(filp, arg);
+    case AESDCHAR_IOCSEEKSEQ:
+        return aesd_ioctl_seekseq(filp, arg);
+    case AESDCHAR_IOCREADSEQ:
+        return aesd_ioctl_readseq(filp, arg);
+    case AESDCHAR_IOCSEEKTIME:
+        return aesd_ioctl_seektime(filp, arg);
+    default:
+        return -ENOTTY;
     }
+}
 
-    for (i = 0; i < seekto.write_cmd; i++) {
-        total_size += dev->buffer.entry[i].size;
+/**
+ * Fill @param total with the sum of the per-CPU statistics of @param dev
+ */
+static void aesd_stats_sum(struct aesd_dev *dev, struct aesd_stats *total)
+{
+    struct aesd_stats *stats;
+    int cpu;
+
+    memset(total, 0, sizeof(*total));
+    for_each_possible_cpu(cpu) {
+        stats = per_cpu_ptr(dev->stats, cpu);
+        total->bytes_written += stats->bytes_written;
+        total->commands_written += stats->commands_written;
+        total->evictions += stats->evictions;
+        total->reads += stats->reads;
+        total->bytes_read += stats->bytes_read;
+        total->seeks += stats->seeks;
+        total->lock_wait_ns += stats->lock_wait_ns;
+        total->partial_bytes_dropped += stats->partial_bytes_dropped;
     }
+}
 
-    // Update file position
-    filp->f_pos = total_size + seekto.write_cmd_offset;
-    mutex_unlock(&dev->lock);
+static int aesd_stats_show(struct seq_file *s, void *unused)
+{
+    struct aesd_stats stats;
+
+    aesd_stats_sum(s->private, &stats);
+    seq_printf(s, "bytes_written %llu\n", stats.bytes_written);
+    seq_printf(s, "commands_written %llu\n", stats.commands_written);
+    seq_printf(s, "evictions %llu\n", stats.evictions);
+    seq_printf(s, "reads %llu\n", stats.reads);
+    seq_printf(s, "bytes_read %llu\n", stats.bytes_read);
+    seq_printf(s, "seeks %llu\n", stats.seeks);
+    seq_printf(s, "lock_wait_ns %llu\n", stats.lock_wait_ns);
+    seq_printf(s, "partial_bytes_dropped %llu\n", stats.partial_bytes_dropped);
     return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(aesd_stats);
+
+/* One read-only sysfs attribute per statistic, in the stats group of each device */
+#define AESD_STATS_ATTR(field) \
+static ssize_t field##_show(struct device *device, struct device_attribute *attr, char *buf) \
+{ \
+    struct aesd_stats stats; \
+    aesd_stats_sum(dev_get_drvdata(device), &stats); \
+    return sysfs_emit(buf, "%llu\n", stats.field); \
+} \
+static DEVICE_ATTR_RO(field)
+
+AESD_STATS_ATTR(bytes_written);
+AESD_STATS_ATTR(commands_written);
+AESD_STATS_ATTR(evictions);
+AESD_STATS_ATTR(reads);
+AESD_STATS_ATTR(bytes_read);
+AESD_STATS_ATTR(seeks);
+AESD_STATS_ATTR(lock_wait_ns);
+AESD_STATS_ATTR(partial_bytes_dropped);
+
+static struct attribute *aesd_stats_attrs[] = {
+    &dev_attr_bytes_written.attr,
+    &dev_attr_commands_written.attr,
+    &dev_attr_evictions.attr,
+    &dev_attr_reads.attr,
+    &dev_attr_bytes_read.attr,
+    &dev_attr_seeks.attr,
+    &dev_attr_lock_wait_ns.attr,
+    &dev_attr_partial_bytes_dropped.attr,
+    NULL,
+};
+
+static const struct attribute_group aesd_stats_group = {
+    .name = "stats",
+    .attrs = aesd_stats_attrs,
+};
+
+static const struct attribute_group *aesd_attr_groups[] = {
+    &aesd_stats_group,
+    NULL,
+};
+
+loff_t aesd_llseek(struct file *filp, loff_t offset, int whence)
+{
+    PDEBUG("llseek");
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    loff_t retval;
+
+    trace_aesd_llseek_enter(MINOR(dev->cdev.dev), offset, filp->f_pos, aesd_circular_buffer_count(&dev->buffer));
+    retval = aesd_do_llseek(filp, offset, whence);
+    trace_aesd_llseek_exit(MINOR(dev->cdev.dev), retval, filp->f_pos, aesd_circular_buffer_count(&dev->buffer));
+    return retval;
+}
+
+long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    PDEBUG("ioctl");
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    long retval;
+
+    trace_aesd_ioctl_enter(MINOR(dev->cdev.dev), cmd, 0, filp->f_pos, aesd_circular_buffer_count(&dev->buffer));
+    retval = aesd_do_ioctl(filp, cmd, arg);
+    trace_aesd_ioctl_exit(MINOR(dev->cdev.dev), cmd, retval, filp->f_pos, aesd_circular_buffer_count(&dev->buffer));
+    return retval;
+}
 
 struct file_operations aesd_fops = {
     .owner =    THIS_MODULE,
-    .read =     aesd_read,
-    .write =    aesd_write,
+    .read_iter =    aesd_read_iter,
+    .write_iter =   aesd_write_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    .splice_read =  copy_splice_read,
+#else
+    .splice_read =  generic_file_splice_read,
+#endif
+    .splice_write = iter_file_splice_write,
     .open =     aesd_open,
     .release =  aesd_release,
     .llseek =   aesd_llseek,
+    .poll =     aesd_poll,
+    .fasync =   aesd_fasync,
+    .mmap =     aesd_mmap,
     .unlocked_ioctl = aesd_unlocked_ioctl,
 };
 
-static int aesd_setup_cdev(struct aesd_dev *dev)
+static int aesd_setup_cdev(struct aesd_dev *dev, int index)
 {
-    int err, devno = MKDEV(aesd_major, aesd_minor);
+    int err, devno = MKDEV(aesd_major, aesd_minor + index);
 
     cdev_init(&dev->cdev, &aesd_fops);
     dev->cdev.owner = THIS_MODULE;
     dev->cdev.ops = &aesd_fops;
     err = cdev_add (&dev->cdev, devno, 1);
     if (err) {
-        printk(KERN_ERR "Error %d adding aesd cdev", err);
+        printk(KERN_ERR "Error %d adding aesd cdev %d", err, index);
     }
     return err;
 }
 
+/**
+ * Initialize the AESD specific portion of the zeroed device @param dev
+ */
+static int aesd_init_device(struct aesd_dev *dev)
+{
+    mutex_init(&dev->lock);  /* Initialize the mutex */
+    seqcount_init(&dev->seq); /* Writers hold lock with preemption disabled to update seq */
+    mutex_init(&dev->mmap_lock); /* Serializes updates of the mmap area */
+    init_waitqueue_head(&dev->read_queue); /* Initialize the reader wait queue */
+    aesd_circular_buffer_init(&dev->buffer); /* Initialize the circular buffer */
+    dev->buffer.max_bytes = aesd_max_bytes;
+    dev->buffer.max_entries = aesd_max_entries;
+
+    dev->mmap_header = vmalloc_user(PAGE_ALIGN(AESD_MMAP_SIZE)); /* Zeroed history mapping */
+    if (!dev->mmap_header) {
+        return -ENOMEM;
+    }
+
+    dev->stats = alloc_percpu(struct aesd_stats); /* Zeroed runtime statistics */
+    if (!dev->stats) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Create the sysfs device and debugfs directory reporting the statistics of @param dev.
+ * Failures are logged but not fatal, the device works without them.
+ */
+static void aesd_setup_stats(struct aesd_dev *dev, int index)
+{
+    struct device *device;
+    char name[24]; // "aesdchar" and any int index
+
+    snprintf(name, sizeof(name), "aesdchar%d", index);
+
+    device = device_create_with_groups(aesd_class, NULL, MKDEV(aesd_major, aesd_minor + index),
+            dev, aesd_attr_groups, "%s", name);
+    if (IS_ERR(device)) {
+        printk(KERN_WARNING "Error %ld creating %s sysfs device", PTR_ERR(device), name);
+    }
 
+    // debugfs errors are deliberately ignored, as recommended for debugfs users
+    dev->debugfs_dir = debugfs_create_dir(name, aesd_debugfs_root);
+    debugfs_create_file("stats", S_IRUGO, dev->debugfs_dir, dev, &aesd_stats_fops);
+}
+
+/**
+ * Free the entries and mapping owned by @param dev, after its cdev has been removed
+ */
+static void aesd_free_device(struct aesd_dev *dev)
+{
+    struct aesd_buffer_entry *entry;
+    uint8_t index;
+
+    AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry, &dev->buffer, index) {
+        aesd_data_put(entry->buffptr);
+    }
+
+    vfree(dev->mmap_header);
+    free_percpu(dev->stats);
+}
+
+/**
+ * Remove the device @param dev at minor offset @param index created by aesd_init_module
+ */
+static void aesd_remove_device(struct aesd_dev *dev, int index)
+{
+    debugfs_remove_recursive(dev->debugfs_dir);
+    device_destroy(aesd_class, MKDEV(aesd_major, aesd_minor + index));
+    cdev_del(&dev->cdev);
+    aesd_free_device(dev);
+}
 
 int aesd_init_module(void)
 {
     dev_t dev = 0;
     int result;
-    result = alloc_chrdev_region(&dev, aesd_minor, 1,
+    int i;
+
+    if (aesd_nr_devs < 1) {
+        printk(KERN_WARNING "Invalid nr_devs %d\n", aesd_nr_devs);
+        return -EINVAL;
+    }
+
+    if (aesd_max_entries < 0 || aesd_max_entries > AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+        printk(KERN_WARNING "Invalid max_entries %d, must be at most %d\n", aesd_max_entries,
+                AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+        return -EINVAL;
+    }
+
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs,
             "aesdchar");
     aesd_major = MAJOR(dev);
     if (result < 0) {
         printk(KERN_WARNING "Can't get major %d\n", aesd_major);
         return result;
     }
-    memset(&aesd_device,0,sizeof(struct aesd_dev));
 
-    /**
-     * TODO: initialize the AESD specific portion of the device
-     */
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL);
+    if (!aesd_devices) {
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return -ENOMEM;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+    aesd_class = class_create("aesdchar");
+#else
+    aesd_class = class_create(THIS_MODULE, "aesdchar");
+#endif
+    if (IS_ERR(aesd_class)) {
+        result = PTR_ERR(aesd_class);
+        kfree(aesd_devices);
+        unregister_chrdev_region(dev, aesd_nr_devs);
+        return result;
+    }
+    aesd_debugfs_root = debugfs_create_dir("aesdchar", NULL);
 
-    mutex_init(&aesd_device.lock);  /* Initialize the mutex */
-    aesd_circular_buffer_init(&aesd_device.buffer); /* Initialize the circular buffer */
+    // Every circular buffer entry needs a descriptor and a slot large enough for a full write
+    BUILD_BUG_ON(AESD_MMAP_MAX_ENTRIES < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    BUILD_BUG_ON(AESD_MMAP_SLOT_SIZE < AESDCHAR_MAX_WRITE_SIZE);
+    BUILD_BUG_ON(sizeof(struct aesd_mmap_header) > AESD_MMAP_DATA_OFFSET);
 
-    result = aesd_setup_cdev(&aesd_device);
+    for (i = 0; i < aesd_nr_devs; i++) {
+        result = aesd_init_device(&aesd_devices[i]);
+        if (!result) {
+            result = aesd_setup_cdev(&aesd_devices[i], i);
+        }
+        if (result) {
+            aesd_free_device(&aesd_devices[i]);
+            goto fail;
+        }
+        aesd_setup_stats(&aesd_devices[i], i);
+    }
 
-    if( result ) {
-        unregister_chrdev_region(dev, 1);
+    return 0;
+
+fail:
+    // Unwind the devices which were fully set up
+    while (i-- > 0) {
+        aesd_remove_device(&aesd_devices[i], i);
     }
+    debugfs_remove_recursive(aesd_debugfs_root);
+    class_destroy(aesd_class);
+    kfree(aesd_devices);
+    unregister_chrdev_region(dev, aesd_nr_devs);
     return result;
 
 }
@@ -328,23 +1532,16 @@ int aesd_init_module(void)
 void aesd_cleanup_module(void)
 {
     dev_t devno = MKDEV(aesd_major, aesd_minor);
+    int i;
 
-    cdev_del(&aesd_device.cdev);
-
-    /**
-     * TODO: cleanup AESD specific poritions here as necessary
-     */
-
-    struct aesd_buffer_entry *entry;
-    uint8_t index;
-
-    AESD_CIRCULAR_BUFFER_FOREACH(entry, &aesd_device.buffer, index) {
-        if (entry->buffptr) {
-            kfree(entry->buffptr);
-        }
+    for (i = 0; i < aesd_nr_devs; i++) {
+        aesd_remove_device(&aesd_devices[i], i);
     }
 
-    unregister_chrdev_region(devno, 1);
+    debugfs_remove_recursive(aesd_debugfs_root);
+    class_destroy(aesd_class);
+    kfree(aesd_devices);
+    unregister_chrdev_region(devno, aesd_nr_devs);
 }
 
 
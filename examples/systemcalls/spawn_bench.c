@@ -0,0 +1,242 @@
+/**
+ * @file spawn_bench.c
+ * @brief Latency of starting a command against the resident size of the calling process,
+ * comparing fork() and execv(), as do_exec() used, with the posix_spawn() do_exec(), and with
+ * starting a batch of commands through do_exec_async() and collecting them with an exec_set.
+ * Also compares "command | command" run by do_system() through the shell with the same
+ * pipeline from exec_pipeline_run().
+ *
+ * Usage: spawn-bench [-n spawns] [-m max_rss_mb] [-c command] [-o results.csv]
+ *
+ * The parent grows its resident set by allocating and touching memory in steps from 0 up to
+ * max_rss_mb, timing the given number of spawns of command (default /bin/true) with each
+ * method at every step.  The async method keeps up to ASYNC_BATCH commands running at once.
+ * Results are printed and written as CSV with one row per method and step:
+ * method,rss_mb,spawns,us_per_spawn.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "systemcalls.h"
+
+#define ASYNC_BATCH 64
+
+static const long rss_steps_mb[] = { 0, 16, 64, 256, 1024, 4096 };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @return the resident set size of this process in MB, from /proc/self/statm
+ */
+static long resident_mb(void)
+{
+    FILE *statm = fopen("/proc/self/statm", "r");
+    long size, resident = 0;
+
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+/**
+ * The fork() and execv() implementation do_exec() had before it used posix_spawn()
+ */
+static bool fork_exec(const char *command)
+{
+    char *argv[] = { (char *)command, NULL };
+    pid_t pid;
+    int status;
+
+    pid = fork();
+    if (pid == -1) {
+        return false;
+    } else if (pid == 0) {
+        execv(command, argv);
+        exit(EXIT_FAILURE);
+    }
+    if (waitpid(pid, &status, 0) == -1) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool posix_spawn_exec(const char *command)
+{
+    return do_exec(1, command);
+}
+
+static void report(FILE *out, const char *method, long rss_mb, long spawns, uint64_t elapsed)
+{
+    printf("%-12s rss %5ld MB %10.1f us/spawn\n", method, rss_mb, (double)elapsed / spawns / 1000);
+    fprintf(out, "%s,%ld,%ld,%.3f\n", method, rss_mb, spawns, (double)elapsed / spawns / 1000);
+}
+
+static void bench(FILE *out, const char *method, bool (*spawn)(const char *), const char *command,
+        long rss_mb, long spawns)
+{
+    uint64_t start;
+    long i;
+
+    start = now_ns();
+    for (i = 0; i < spawns; i++) {
+        if (!spawn(command)) {
+            fprintf(stderr, "%s of %s failed\n", method, command);
+            exit(1);
+        }
+    }
+    report(out, method, rss_mb, spawns, now_ns() - start);
+}
+
+static bool system_pipeline(const char *command)
+{
+    char line[PATH_MAX * 2 + 4];
+
+    snprintf(line, sizeof(line), "%s | %s", command, command);
+    return do_system(line);
+}
+
+static bool exec_pipeline(const char *command)
+{
+    struct exec_pipeline pipeline;
+    bool success;
+
+    exec_pipeline_init(&pipeline);
+    success = exec_pipeline_add(&pipeline, 1, command) && exec_pipeline_add(&pipeline, 1, command) &&
+            exec_pipeline_run(&pipeline);
+    exec_pipeline_free(&pipeline);
+    return success;
+}
+
+/**
+ * Run @param spawns commands with up to ASYNC_BATCH at a time, starting another each time
+ * one exits
+ */
+static void bench_async(FILE *out, const char *command, long rss_mb, long spawns)
+{
+    struct exec_handle handles[ASYNC_BATCH];
+    struct exec_handle *handle;
+    struct exec_set set;
+    uint64_t start;
+    long started = 0;
+    int i;
+
+    if (!exec_set_init(&set)) {
+        perror("exec_set_init");
+        exit(1);
+    }
+
+    start = now_ns();
+    for (i = 0; i < ASYNC_BATCH && started < spawns; i++, started++) {
+        if (!do_exec_async(&handles[i], 1, command) || !exec_set_add(&set, &handles[i])) {
+            fprintf(stderr, "async of %s failed\n", command);
+            exit(1);
+        }
+    }
+    while ((handle = exec_set_wait_any(&set, -1)) != NULL) {
+        if (!exec_wait(handle)) {
+            fprintf(stderr, "async of %s failed\n", command);
+            exit(1);
+        }
+        if (started < spawns) {
+            if (!do_exec_async(handle, 1, command) || !exec_set_add(&set, handle)) {
+                fprintf(stderr, "async of %s failed\n", command);
+                exit(1);
+            }
+            started++;
+        }
+    }
+    report(out, "async", rss_mb, spawns, now_ns() - start);
+
+    exec_set_destroy(&set);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "spawn_bench.csv";
+    const char *command = "/bin/true";
+    long spawns = 200;
+    long max_rss_mb = 1024;
+    char *ballast = NULL;
+    long ballast_mb = 0;
+    size_t step;
+    FILE *out;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:c:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            spawns = atol(optarg);
+            break;
+        case 'm':
+            max_rss_mb = atol(optarg);
+            break;
+        case 'c':
+            command = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n spawns] [-m max_rss_mb] [-c command] [-o results.csv]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (spawns < 1 || max_rss_mb < 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    out = fopen(output, "w");
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    fprintf(out, "method,rss_mb,spawns,us_per_spawn\n");
+
+    for (step = 0; step < sizeof(rss_steps_mb) / sizeof(rss_steps_mb[0]); step++) {
+        if (rss_steps_mb[step] > max_rss_mb)
+            break;
+
+        // Grow the ballast and touch every page so it is resident and mapped in the page tables
+        if (rss_steps_mb[step] > ballast_mb) {
+            char *grown = realloc(ballast, rss_steps_mb[step] * 1024 * 1024);
+
+            if (!grown) {
+                perror("realloc");
+                break;
+            }
+            ballast = grown;
+            memset(ballast + ballast_mb * 1024 * 1024, 1,
+                    (rss_steps_mb[step] - ballast_mb) * 1024 * 1024);
+            ballast_mb = rss_steps_mb[step];
+        }
+
+        bench(out, "fork+execv", fork_exec, command, resident_mb(), spawns);
+        bench(out, "posix_spawn", posix_spawn_exec, command, resident_mb(), spawns);
+        bench_async(out, command, resident_mb(), spawns);
+        bench(out, "system|", system_pipeline, command, resident_mb(), spawns);
+        bench(out, "pipeline", exec_pipeline, command, resident_mb(), spawns);
+    }
+
+    free(ballast);
+    fclose(out);
+    printf("Results written to %s\n", output);
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // pipe2() and splice()
 #include "systemcalls.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,6 +7,21 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+extern char **environ;
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434 // Linux 5.3, the same number on every architecture
+#endif
+
+#define CAPTURE_READ_SIZE 4096      // least space to read into, the initial exec_output capacity
+#define SPLICE_SIZE (64 * 1024)     // the default pipe capacity
 
 /**
  * @param cmd the command to execute with system()
@@ -30,6 +46,82 @@ bool do_system(const char *cmd)
     return true;
 }
 
+/**
+ * Start @param command with posix_spawn().  glibc implements posix_spawn() with
+ * clone(CLONE_VM|CLONE_VFORK), so unlike fork() the cost doesn't grow with the size of the
+ * calling process, which never has its page tables copied.
+ * @param command the full path to the command followed by its arguments, NULL terminated
+ * @param stdio if not NULL, the file descriptors to duplicate onto standard in, out and error
+ *   of the command, -1 for any to be inherited unchanged
+ * @param outputfile if not NULL, the file opened as standard out of the command, by a spawn
+ *   file action in place of open() and dup2() in a forked child
+ * @param pid set to the process ID of the command
+ * @return true if the command was started
+ */
+static bool spawn_command(char *const command[], const int stdio[3], const char *outputfile,
+        pid_t *pid)
+{
+    posix_spawn_file_actions_t actions;
+    int ret = 0;
+    int fd;
+
+    if (posix_spawn_file_actions_init(&actions) != 0) {
+        return false;
+    }
+    for (fd = STDIN_FILENO; stdio && fd <= STDERR_FILENO && ret == 0; fd++) {
+        if (stdio[fd] != -1) {
+            ret = posix_spawn_file_actions_adddup2(&actions, stdio[fd], fd);
+        }
+    }
+    if (outputfile && ret == 0) {
+        ret = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, outputfile,
+                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (ret != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return false;
+    }
+
+    ret = posix_spawn(pid, command[0], &actions, NULL, command, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return ret == 0; // if not, fork, open or execv failed and the error is in ret
+}
+
+/**
+ * @return true if @param status from waitpid() is of a normal exit with status 0
+ */
+static bool exited_successfully(int status)
+{
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Wait for the process @param pid to exit
+ * @param status set to its wait status
+ * @return true if it exited with status 0
+ */
+static bool wait_command(pid_t pid, int *status)
+{
+    while (waitpid(pid, status, 0) == -1) {
+        if (errno != EINTR) {
+            *status = -1;
+            return false;
+        }
+    }
+    return exited_successfully(*status);
+}
+
+static bool spawn_and_wait(char *const command[], const char *outputfile)
+{
+    pid_t pid;
+    int status;
+
+    if (!spawn_command(command, NULL, outputfile, &pid)) {
+        return false;
+    }
+    return wait_command(pid, &status);
+}
+
 /**
 * @param count -The numbers of variables passed to the function. The variables are command to execute.
 *   followed by arguments to pass to the command
@@ -55,6 +147,7 @@ bool do_exec(int count, ...)
         command[i] = va_arg(args, char *);
     }
     command[count] = NULL;
+    va_end(args);
     // this line is to avoid a compile warning before your implementation is complete
     // and may be removed
     command[count] = command[count];
@@ -69,27 +162,7 @@ bool do_exec(int count, ...)
  *
 */
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        return false;
-    } else if (pid == 0) {
-        execv(command[0], command);
-        exit(EXIT_FAILURE); // exit if execv fails
-    } else {
-        int status;
-        if (waitpid(pid, &status, 0) == -1) {
-            return false;
-        }
-        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-            return true;
-        } else {
-            return false;
-        }
-    }
-
-    va_end(args);
-
-    return true;
+    return spawn_and_wait(command, NULL);
 }
 
 /**
@@ -108,6 +181,7 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
         command[i] = va_arg(args, char *);
     }
     command[count] = NULL;
+    va_end(args);
     // this line is to avoid a compile warning before your implementation is complete
     // and may be removed
     command[count] = command[count];
@@ -122,34 +196,531 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
 */
 
 
-    pid_t pid = fork();
-    if (pid == -1) {
+    return spawn_and_wait(command, outputfile);
+}
+
+/**
+* @param handle - Filled in with the process ID and a pidfd for the started command.
+* All other parameters, see do_exec above
+*/
+bool do_exec_async(struct exec_handle *handle, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+    va_end(args);
+
+    handle->pidfd = -1;
+    handle->status = -1;
+    handle->done = false;
+    handle->set = NULL;
+    if (!spawn_command(command, NULL, NULL, &handle->pid)) {
+        // posix_spawn() leaves the pid unspecified, make sure exec_wait() never waits for it
+        handle->pid = -1;
+        handle->done = true;
+        return false;
+    }
+
+    // The child can't be reaped before we wait for it, so its pid can't have been reused yet
+    handle->pidfd = syscall(SYS_pidfd_open, handle->pid, 0);
+    if (handle->pidfd == -1) {
+        kill(handle->pid, SIGKILL);
+        wait_command(handle->pid, &handle->status);
+        handle->done = true;
         return false;
-    } else if (pid == 0) {
-        int fd = open(outputfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd == -1) {
-            exit(EXIT_FAILURE); // exit if open fails
-        }
-        if (dup2(fd, STDOUT_FILENO) == -1) {
-            close(fd);
-            exit(EXIT_FAILURE); // exit if dup2 fails
-        }
-        close(fd);
-        execv(command[0], command);
-        exit(EXIT_FAILURE); // exit if execv fails
+    }
+    return true;
+}
+
+/**
+ * Reap the exited or exiting command of @param handle and close its pidfd
+ */
+static bool exec_reap(struct exec_handle *handle)
+{
+    wait_command(handle->pid, &handle->status);
+    close(handle->pidfd);
+    handle->pidfd = -1;
+    handle->done = true;
+    return exited_successfully(handle->status);
+}
+
+/**
+ * Take @param handle out of its set, so the set no longer waits for it or counts it as running
+ */
+static void exec_set_remove(struct exec_handle *handle)
+{
+    struct exec_set *set = handle->set;
+
+    // Closing the pidfd only drops it from the set once no other process holds a copy of it
+    epoll_ctl(set->epfd, EPOLL_CTL_DEL, handle->pidfd, NULL);
+    if (handle->set_prev) {
+        handle->set_prev->set_next = handle->set_next;
     } else {
-        int status;
-        if (waitpid(pid, &status, 0) == -1) {
+        set->head = handle->set_next;
+    }
+    if (handle->set_next) {
+        handle->set_next->set_prev = handle->set_prev;
+    }
+    handle->set = NULL;
+    set->running--;
+}
+
+bool exec_wait(struct exec_handle *handle)
+{
+    if (handle->set) {
+        exec_set_remove(handle);
+    }
+    if (handle->done) {
+        return exited_successfully(handle->status);
+    }
+    return exec_reap(handle);
+}
+
+bool exec_set_init(struct exec_set *set)
+{
+    set->epfd = epoll_create1(EPOLL_CLOEXEC);
+    set->running = 0;
+    set->head = NULL;
+    return set->epfd != -1;
+}
+
+bool exec_set_add(struct exec_set *set, struct exec_handle *handle)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = handle };
+
+    if (handle->done || handle->set || epoll_ctl(set->epfd, EPOLL_CTL_ADD, handle->pidfd, &event) == -1) {
+        return false;
+    }
+    handle->set = set;
+    handle->set_prev = NULL;
+    handle->set_next = set->head;
+    if (set->head) {
+        set->head->set_prev = handle;
+    }
+    set->head = handle;
+    set->running++;
+    return true;
+}
+
+struct exec_handle *exec_set_wait_any(struct exec_set *set, int timeout_ms)
+{
+    struct epoll_event event;
+    struct exec_handle *handle;
+    int ret;
+
+    if (set->running == 0) {
+        return NULL;
+    }
+
+    do {
+        ret = epoll_wait(set->epfd, &event, 1, timeout_ms);
+    } while (ret == -1 && errno == EINTR);
+    if (ret != 1) {
+        return NULL;
+    }
+
+    handle = event.data.ptr;
+    exec_set_remove(handle);
+    exec_reap(handle);
+    return handle;
+}
+
+bool exec_set_wait_all(struct exec_set *set)
+{
+    struct exec_handle *handle;
+    bool success = true;
+
+    while (set->running > 0) {
+        handle = exec_set_wait_any(set, -1);
+        if (!handle) {
             return false;
         }
-        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        if (!exited_successfully(handle->status)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+void exec_set_destroy(struct exec_set *set)
+{
+    struct exec_handle *handle;
+
+    for (handle = set->head; handle; handle = handle->set_next) {
+        handle->set = NULL;
+    }
+    set->head = NULL;
+    close(set->epfd);
+    set->epfd = -1;
+    set->running = 0;
+}
+
+/**
+ * Read what is available from @param fd onto the end of @param output, growing it as needed
+ * @return the result of read(), 0 at end of file or -1 if it or growing the buffer failed
+ */
+static ssize_t capture_read(int fd, struct exec_output *output)
+{
+    size_t capacity = output->capacity;
+    ssize_t len;
+
+    // Leave room for at least CAPTURE_READ_SIZE bytes plus the terminating NUL
+    if (capacity < CAPTURE_READ_SIZE) {
+        capacity = CAPTURE_READ_SIZE;
+    }
+    while (capacity - output->size <= CAPTURE_READ_SIZE) {
+        capacity *= 2;
+    }
+    if (capacity != output->capacity) {
+        char *data = realloc(output->data, capacity);
+
+        if (!data) {
+            return -1;
+        }
+        output->data = data;
+        output->capacity = capacity;
+    }
+
+    do {
+        len = read(fd, output->data + output->size, output->capacity - output->size - 1);
+    } while (len == -1 && errno == EINTR);
+    if (len > 0) {
+        output->size += len;
+    }
+    output->data[output->size] = '\0';
+    return len;
+}
+
+/**
+* @param out - The command's standard out is appended to out->data.
+* @param err - The command's standard error is appended to err->data, NULL to leave it unchanged.
+* All other parameters, see do_exec above
+*/
+bool do_exec_capture(struct exec_output *out, struct exec_output *err, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+    va_end(args);
+
+    struct exec_output *outputs[2] = { out, err };
+    struct pollfd fds[2] = { { .fd = -1 }, { .fd = -1 } };
+    int stdio[3] = { -1, -1, -1 };
+    bool success = false;
+    ssize_t len;
+    pid_t pid;
+    int status;
+    int open_fds = 0;
+
+    // Pipes for standard out and error, the read ends in fds[] and the write ends in stdio[]
+    for (i = 0; i < 2; i++) {
+        int pipefd[2];
+
+        if (!outputs[i]) {
+            continue;
+        }
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            goto close_pipes;
+        }
+        fds[i].fd = pipefd[0];
+        fds[i].events = POLLIN;
+        stdio[i + 1] = pipefd[1];
+        open_fds++;
+    }
+
+    if (!spawn_command(command, stdio, NULL, &pid)) {
+        goto close_pipes;
+    }
+    // Close our copies of the write ends so the reads see end of file when the command exits
+    for (i = 1; i <= 2; i++) {
+        if (stdio[i] != -1) {
+            close(stdio[i]);
+            stdio[i] = -1;
+        }
+    }
+
+    success = true;
+    while (open_fds > 0) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            success = false;
+            break;
+        }
+        for (i = 0; i < 2; i++) {
+            if (fds[i].fd == -1 || !fds[i].revents) {
+                continue;
+            }
+            len = capture_read(fds[i].fd, outputs[i]);
+            if (len <= 0) {
+                // On an error the command gets EPIPE or SIGPIPE for any more output
+                if (len < 0) {
+                    success = false;
+                }
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_fds--;
+            }
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (fds[i].fd != -1) {
+            close(fds[i].fd);
+            fds[i].fd = -1;
+        }
+    }
+    if (!wait_command(pid, &status)) {
+        success = false;
+    }
+
+close_pipes:
+    for (i = 0; i < 2; i++) {
+        if (fds[i].fd != -1) {
+            close(fds[i].fd);
+        }
+        if (stdio[i + 1] != -1) {
+            close(stdio[i + 1]);
+        }
+    }
+    return success;
+}
+
+/**
+ * Copy from @param in to @param out with read() and write(), for when splice() can't be used
+ * @param bytes incremented by the number of bytes copied
+ * @return true on end of file, false on an error
+ */
+static bool copy_fd(int in, int out, size_t *bytes)
+{
+    char buf[CAPTURE_READ_SIZE];
+    ssize_t len;
+    ssize_t written;
+    ssize_t ret;
+
+    for (;;) {
+        len = read(in, buf, sizeof(buf));
+        if (len == 0) {
             return true;
-        } else {
+        }
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
             return false;
         }
+        for (written = 0; written < len; written += ret) {
+            ret = write(out, buf + written, len - written);
+            if (ret == -1) {
+                if (errno != EINTR) {
+                    return false;
+                }
+                ret = 0;
+            }
+        }
+        *bytes += len;
     }
+}
 
+/**
+* @param fd - The file descriptor to write the command's standard out to.
+* @param bytes - If not NULL, set to the number of bytes written to @param fd.
+* All other parameters, see do_exec above
+*/
+bool do_exec_splice(int fd, size_t *bytes, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
     va_end(args);
 
+    int pipefd[2];
+    int stdio[3] = { -1, -1, -1 };
+    size_t total = 0;
+    bool success = true;
+    ssize_t len;
+    pid_t pid;
+    int status;
+
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        return false;
+    }
+    stdio[STDOUT_FILENO] = pipefd[1];
+    if (!spawn_command(command, stdio, NULL, &pid)) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return false;
+    }
+    close(pipefd[1]);
+
+    for (;;) {
+        len = splice(pipefd[0], NULL, fd, NULL, SPLICE_SIZE, SPLICE_F_MOVE);
+        if (len > 0) {
+            total += len;
+            continue;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        // EINVAL if fd doesn't support splice(), e.g. it was opened with O_APPEND
+        success = errno == EINVAL && copy_fd(pipefd[0], fd, &total);
+        break;
+    }
+    close(pipefd[0]);
+
+    if (bytes) {
+        *bytes = total;
+    }
+    if (!wait_command(pid, &status)) {
+        success = false;
+    }
+    return success;
+}
+
+void exec_pipeline_init(struct exec_pipeline *pipeline)
+{
+    pipeline->count = 0;
+    pipeline->outputfile = NULL;
+}
+
+/**
+* @param pipeline - The pipeline to append the command to.
+* All other parameters, see do_exec above
+*/
+bool exec_pipeline_add(struct exec_pipeline *pipeline, int count, ...)
+{
+    va_list args;
+    char **command;
+    int i;
+
+    if (pipeline->count == EXEC_PIPELINE_MAX_STAGES || count < 1) {
+        return false;
+    }
+    command = malloc((count + 1) * sizeof(*command));
+    if (!command) {
+        return false;
+    }
+
+    va_start(args, count);
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+    va_end(args);
+
+    pipeline->stage[pipeline->count].command = command;
+    pipeline->stage[pipeline->count].pid = -1;
+    pipeline->stage[pipeline->count].status = -1;
+    pipeline->count++;
     return true;
 }
+
+void exec_pipeline_redirect(struct exec_pipeline *pipeline, const char *outputfile)
+{
+    pipeline->outputfile = outputfile;
+}
+
+bool exec_pipeline_run(struct exec_pipeline *pipeline)
+{
+    int stdio[3] = { -1, -1, -1 };
+    int pipefd[2];
+    bool success = true;
+    bool started;
+    bool last;
+    int i;
+
+    for (i = 0; i < pipeline->count; i++) {
+        pipeline->stage[i].pid = -1;
+        pipeline->stage[i].status = -1;
+    }
+
+    // Each stage reads the pipe written by the one before, the last writes to outputfile
+    for (i = 0; i < pipeline->count; i++) {
+        last = i == pipeline->count - 1;
+        stdio[STDOUT_FILENO] = -1;
+        if (!last) {
+            if (pipe2(pipefd, O_CLOEXEC) == -1) {
+                success = false;
+                break;
+            }
+            stdio[STDOUT_FILENO] = pipefd[1];
+        }
+
+        started = spawn_command(pipeline->stage[i].command, stdio,
+                last ? pipeline->outputfile : NULL, &pipeline->stage[i].pid);
+
+        // Only the stages may hold the pipe ends, so each sees end of file or EPIPE in turn
+        if (stdio[STDIN_FILENO] != -1) {
+            close(stdio[STDIN_FILENO]);
+            stdio[STDIN_FILENO] = -1;
+        }
+        if (!last) {
+            close(pipefd[1]);
+            stdio[STDIN_FILENO] = pipefd[0];
+        }
+        if (!started) {
+            pipeline->stage[i].pid = -1;
+            success = false;
+            break;
+        }
+    }
+    if (stdio[STDIN_FILENO] != -1) {
+        close(stdio[STDIN_FILENO]);
+    }
+
+    for (i = 0; i < pipeline->count && pipeline->stage[i].pid != -1; i++) {
+        if (!wait_command(pipeline->stage[i].pid, &pipeline->stage[i].status)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+int exec_pipeline_failed_stage(const struct exec_pipeline *pipeline)
+{
+    int failed = -1;
+    int i;
+
+    for (i = 0; i < pipeline->count; i++) {
+        if (pipeline->stage[i].pid == -1) {
+            return i; // no later stages were started
+        }
+        if (!exited_successfully(pipeline->stage[i].status)) {
+            failed = i;
+        }
+    }
+    return failed;
+}
+
+void exec_pipeline_free(struct exec_pipeline *pipeline)
+{
+    int i;
+
+    for (i = 0; i < pipeline->count; i++) {
+        free(pipeline->stage[i].command);
+    }
+    pipeline->count = 0;
+}
@@ -1,9 +1,157 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <sys/types.h>
 
 bool do_system(const char *command);
 
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * A command started by do_exec_async() and not yet waited for
+ */
+struct exec_handle {
+    pid_t pid;
+    int pidfd;      // readable once the command exits, -1 after it is waited for
+    int status;     // wait status from waitpid() once done
+    bool done;
+    struct exec_set *set;           // the set it was added to and not yet returned by, or NULL
+    struct exec_handle *set_prev;   // neighbours in the set's list of handles
+    struct exec_handle *set_next;
+};
+
+/**
+ * Start a command as do_exec() does, without waiting for it to exit.
+ * @param handle filled in for exec_wait() or exec_set_add().  If the command could not be
+ *   started it is left done, so exec_wait() returns false without waiting.
+ * @return true if the command was started, false if it or its pidfd could not be
+ */
+bool do_exec_async(struct exec_handle *handle, int count, ...);
+
+/**
+ * Wait for the command in @param handle to exit.  If it is in an exec_set, it is removed
+ * from the set first, so the set doesn't wait for it again.
+ * @return true if it exited with status 0
+ */
+bool exec_wait(struct exec_handle *handle);
+
+/**
+ * Commands started by do_exec_async() waited for together through epoll on their pidfds
+ */
+struct exec_set {
+    int epfd;
+    int running;                // added handles not yet returned by exec_set_wait_any()
+    struct exec_handle *head;   // list of those handles
+};
+
+bool exec_set_init(struct exec_set *set);
+
+/**
+ * Add @param handle, which must stay valid until exec_set_wait_any() returns it, exec_wait()
+ * is called on it or the set is destroyed
+ */
+bool exec_set_add(struct exec_set *set, struct exec_handle *handle);
+
+/**
+ * Wait up to @param timeout_ms, or forever if negative, for any command in @param set to exit
+ * @return the handle of the command which exited, or NULL on timeout, error or if no
+ *   commands are running
+ */
+struct exec_handle *exec_set_wait_any(struct exec_set *set, int timeout_ms);
+
+/**
+ * Wait for every command in @param set to exit
+ * @return true if all of them exited with status 0
+ */
+bool exec_set_wait_all(struct exec_set *set);
+
+/**
+ * Close @param set.  Any commands still running are no longer tracked by it, and must be
+ * waited for with exec_wait().
+ */
+void exec_set_destroy(struct exec_set *set);
+
+/**
+ * Growable buffer for command output.  Start from { NULL, 0, 0 } or with data allocated by
+ * malloc() of capacity bytes, and free() data when done.
+ */
+struct exec_output {
+    char *data;         // size bytes of output followed by a NUL
+    size_t size;
+    size_t capacity;
+};
+
+/**
+ * Execute a command as do_exec() does, with its standard out and error connected to pipes
+ * which are read into memory instead of a file.
+ * @param out the command's standard out is appended to it
+ * @param err the command's standard error is appended to it, or if NULL standard error is
+ *   left unchanged
+ * @return true if the command exited with status 0 and all of its output was captured
+ */
+bool do_exec_capture(struct exec_output *out, struct exec_output *err, int count, ...);
+
+/**
+ * Execute a command as do_exec() does, moving its standard out to @param fd through a pipe
+ * with splice(), so the output is never copied through user space.
+ * @param bytes if not NULL, set to the number of bytes written to @param fd
+ * @return true if the command exited with status 0 and all of its output was written
+ */
+bool do_exec_splice(int fd, size_t *bytes, int count, ...);
+
+#define EXEC_PIPELINE_MAX_STAGES 16
+
+/**
+ * One command of a pipeline
+ */
+struct exec_stage {
+    char **command;     // full path to the command and its arguments, NULL terminated
+    pid_t pid;          // -1 if not started
+    int status;         // wait status once run, -1 if the command could not be started
+};
+
+/**
+ * Commands run connected by pipes, as the shell runs "cmd1 | cmd2 | cmd3 > outputfile", but
+ * without starting a shell or parsing a command line
+ */
+struct exec_pipeline {
+    struct exec_stage stage[EXEC_PIPELINE_MAX_STAGES];
+    int count;
+    const char *outputfile;     // standard out of the last stage if not NULL
+};
+
+void exec_pipeline_init(struct exec_pipeline *pipeline);
+
+/**
+ * Append a stage reading the standard out of the previous one.  The parameters after
+ * @param pipeline are as for do_exec(), the strings must remain valid until
+ * exec_pipeline_run() returns.
+ * @return false if there are already EXEC_PIPELINE_MAX_STAGES stages or out of memory
+ */
+bool exec_pipeline_add(struct exec_pipeline *pipeline, int count, ...);
+
+/**
+ * Write the standard out of the last stage to @param outputfile, as do_exec_redirect() does
+ */
+void exec_pipeline_redirect(struct exec_pipeline *pipeline, const char *outputfile);
+
+/**
+ * Start every stage and wait for all of them to exit.  The result of each stage is left in
+ * its status.
+ * @return true if every stage exited with status 0
+ */
+bool exec_pipeline_run(struct exec_pipeline *pipeline);
+
+/**
+ * @return the index of the stage which could not be started or, as with the shell's pipefail
+ *   option, the last which didn't exit with status 0, since earlier stages usually only fail
+ *   with SIGPIPE after a later one stops reading.  -1 if every stage succeeded.
+ */
+int exec_pipeline_failed_stage(const struct exec_pipeline *pipeline);
+
+/**
+ * Free the stages of @param pipeline, leaving it empty
+ */
+void exec_pipeline_free(struct exec_pipeline *pipeline);
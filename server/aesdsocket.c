@@ -3,6 +3,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <syslog.h>
@@ -18,6 +19,7 @@
 #define BACKLOG 10
 #define FILE_PATH "/var/tmp/aesdsocketdata"
 #define SOCKET_PID_FILE "/var/run/aesdsocket.pid"
+#define SENDFILE_CHUNK_SIZE 65536
 
 // Mutex for thread synchronization
 pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -115,35 +117,33 @@ int handle_aesd_ioctl_seek(int client_fd, const char *buffer) {
         return -1;
     }
 
-    // Now read back from the driver after the seek and append the remaining content
-    int bytes_read = read(aesd_fd, driver_buffer, sizeof(driver_buffer) - 1); // Read data from the current seek position
-    if (bytes_read == -1) {
-        syslog(LOG_ERR, "Failed to read from AESD char device after seek: %s", strerror(errno));
+    // Find the end of the data now, a driver loaded with tail_reads=1 blocks reads at the end
+    // until another command is written rather than returning end of file
+    off_t seek_pos = lseek(aesd_fd, 0, SEEK_CUR);
+    off_t end_pos = lseek(aesd_fd, 0, SEEK_END);
+    if (seek_pos == -1 || end_pos == -1 || lseek(aesd_fd, seek_pos, SEEK_SET) == -1) {
+        syslog(LOG_ERR, "Failed to find the end of the AESD char device data: %s", strerror(errno));
         close(aesd_fd);
         return -1;
     }
 
-    // Null-terminate the buffer
-    driver_buffer[bytes_read] = '\0';
-
-    // Send the result back to the client
-    if (send(client_fd, driver_buffer, bytes_read, 0) == -1) {
-        syslog(LOG_ERR, "Failed to send data back to client: %s", strerror(errno));
+    // Stream everything from the seek position to that end to the client, the driver splices it
+    // without a userspace copy
+    ssize_t bytes_sent = 0;
+    off_t remaining = end_pos - seek_pos;
+    while (remaining > 0 &&
+            (bytes_sent = sendfile(client_fd, aesd_fd, NULL,
+                    remaining < SENDFILE_CHUNK_SIZE ? remaining : SENDFILE_CHUNK_SIZE)) > 0) {
+        syslog(LOG_INFO, "Sent %zd bytes from AESD char device", bytes_sent);
+        remaining -= bytes_sent;
+    }
+    if (bytes_sent == -1) {
+        syslog(LOG_ERR, "Failed to send data from AESD char device to client: %s", strerror(errno));
         close(aesd_fd);
         return -1;
     }
 
-    // Read and append the remaining content until the end of the file
-    while ((bytes_read = read(aesd_fd, driver_buffer, sizeof(driver_buffer) - 1)) > 0) {
-        driver_buffer[bytes_read] = '\0';  // Null-terminate the buffer
-        if (send(client_fd, driver_buffer, bytes_read, 0) == -1) {
-            syslog(LOG_ERR, "Failed to send remaining data to client: %s", strerror(errno));
-            close(aesd_fd);
-            return -1;
-        }
-    }
-
-    syslog(LOG_INFO, "Sent the remaining data from seek position to the end of the buffer");
+    syslog(LOG_INFO, "Sent the data from the seek position to the end of the buffer");
 
     // Close the driver
     close(aesd_fd);
@@ -0,0 +1,111 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+void test_exec_async_exit_status()
+{
+    struct exec_handle success, failure, status3;
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_async(&success, 1, "/bin/true"), "/bin/true should start");
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_async(&failure, 1, "/bin/false"), "/bin/false should start");
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_async(&status3, 3, "/bin/sh", "-c", "exit 3"),
+            "/bin/sh should start");
+
+    TEST_ASSERT_TRUE_MESSAGE(exec_wait(&success), "/bin/true exits with status 0");
+    TEST_ASSERT_FALSE_MESSAGE(exec_wait(&failure), "/bin/false's failure is returned");
+    TEST_ASSERT_FALSE_MESSAGE(exec_wait(&status3), "A nonzero exit status is a failure");
+    TEST_ASSERT_TRUE(WIFEXITED(status3.status));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(3, WEXITSTATUS(status3.status), "The exit status is kept in the handle");
+
+    TEST_ASSERT_FALSE_MESSAGE(exec_wait(&failure), "Waiting again returns the same result");
+    TEST_ASSERT_EQUAL_INT(-1, failure.pidfd);
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_async(&failure, 1, "/nonexistent/command"),
+            "A command that can't be executed isn't started");
+}
+
+void test_exec_wait_after_failed_spawn()
+{
+    struct exec_handle failed;
+    struct exec_handle running;
+    struct exec_set set;
+
+    // A child of this process which the failed handle must not reap
+    TEST_ASSERT_TRUE(do_exec_async(&running, 2, "/bin/sleep", "0.2"));
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_async(&failed, 1, "/nonexistent/command"),
+            "A command that can't be executed isn't started");
+    TEST_ASSERT_TRUE_MESSAGE(failed.done, "A handle which failed to start is done");
+    TEST_ASSERT_EQUAL_INT(-1, failed.pid);
+    TEST_ASSERT_EQUAL_INT(-1, failed.pidfd);
+    TEST_ASSERT_FALSE_MESSAGE(exec_wait(&failed), "Waiting on a failed spawn returns false");
+    TEST_ASSERT_EQUAL_INT(-1, failed.status);
+
+    TEST_ASSERT_TRUE(exec_set_init(&set));
+    TEST_ASSERT_FALSE_MESSAGE(exec_set_add(&set, &failed), "A failed spawn can't join a set");
+    exec_set_destroy(&set);
+
+    TEST_ASSERT_FALSE_MESSAGE(running.done, "The other child is still running");
+    TEST_ASSERT_TRUE_MESSAGE(exec_wait(&running), "The other child is reaped by its own handle");
+}
+
+void test_exec_set_wait_any_and_all()
+{
+    struct exec_handle handles[3];
+    struct exec_handle *handle;
+    struct exec_set set;
+
+    TEST_ASSERT_TRUE(exec_set_init(&set));
+    TEST_ASSERT_NULL_MESSAGE(exec_set_wait_any(&set, -1), "An empty set doesn't wait");
+
+    TEST_ASSERT_TRUE(do_exec_async(&handles[0], 2, "/bin/sleep", "0.5"));
+    TEST_ASSERT_TRUE(do_exec_async(&handles[1], 1, "/bin/true"));
+    TEST_ASSERT_TRUE(exec_set_add(&set, &handles[0]));
+    TEST_ASSERT_TRUE(exec_set_add(&set, &handles[1]));
+    TEST_ASSERT_FALSE_MESSAGE(exec_set_add(&set, &handles[1]), "A handle can't be added twice");
+    TEST_ASSERT_EQUAL_INT(2, set.running);
+
+    handle = exec_set_wait_any(&set, -1);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(&handles[1], handle, "The command which exits first is returned first");
+    TEST_ASSERT_TRUE(handle->done);
+    TEST_ASSERT_TRUE(exec_wait(handle));
+    TEST_ASSERT_NULL_MESSAGE(exec_set_wait_any(&set, 0), "No other command has exited yet");
+
+    TEST_ASSERT_TRUE(do_exec_async(&handles[2], 3, "/bin/sh", "-c", "exit 5"));
+    TEST_ASSERT_TRUE(exec_set_add(&set, &handles[2]));
+    TEST_ASSERT_FALSE_MESSAGE(exec_set_wait_all(&set), "wait_all reports a failed command");
+    TEST_ASSERT_EQUAL_INT(0, set.running);
+    TEST_ASSERT_TRUE(exec_wait(&handles[0]));
+    TEST_ASSERT_EQUAL_INT(5, WEXITSTATUS(handles[2].status));
+
+    exec_set_destroy(&set);
+}
+
+void test_exec_wait_on_handle_in_set()
+{
+    struct exec_handle handles[2];
+    struct exec_set set;
+
+    TEST_ASSERT_TRUE(exec_set_init(&set));
+    TEST_ASSERT_TRUE(do_exec_async(&handles[0], 1, "/bin/true"));
+    TEST_ASSERT_TRUE(do_exec_async(&handles[1], 1, "/bin/false"));
+    TEST_ASSERT_TRUE(exec_set_add(&set, &handles[0]));
+    TEST_ASSERT_TRUE(exec_set_add(&set, &handles[1]));
+
+    // Waiting directly takes the handle out of the set, so wait_all doesn't wait for it forever
+    TEST_ASSERT_TRUE(exec_wait(&handles[0]));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, set.running, "exec_wait() removes the handle from its set");
+    TEST_ASSERT_FALSE_MESSAGE(exec_set_wait_all(&set), "wait_all returns once the other command exits");
+    TEST_ASSERT_EQUAL_INT(0, set.running);
+    exec_set_destroy(&set);
+
+    // A handle still in a destroyed set can be waited for on its own
+    TEST_ASSERT_TRUE(exec_set_init(&set));
+    TEST_ASSERT_TRUE(do_exec_async(&handles[0], 1, "/bin/true"));
+    TEST_ASSERT_TRUE(exec_set_add(&set, &handles[0]));
+    exec_set_destroy(&set);
+    TEST_ASSERT_NULL(handles[0].set);
+    TEST_ASSERT_TRUE(exec_wait(&handles[0]));
+}
@@ -0,0 +1,134 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+// Enough lines of seq output for several times the default 64KiB pipe buffer
+#define SEQ_LINES "40000"
+#define SEQ_LINES_COUNT 40000
+
+/**
+ * @return the output of "seq 1 SEQ_LINES", allocated with malloc(), with its length in @param size
+ */
+static char *expected_seq(size_t *size)
+{
+    char *expected = malloc(SEQ_LINES_COUNT * 7);
+    size_t len = 0;
+    int i;
+
+    TEST_ASSERT_NOT_NULL(expected);
+    for (i = 1; i <= SEQ_LINES_COUNT; i++)
+        len += sprintf(expected + len, "%d\n", i);
+    *size = len;
+    return expected;
+}
+
+/**
+ * Reads back the whole of the file @param fd, allocated with malloc(), with its length in @param size
+ */
+static char *read_back(int fd, size_t *size)
+{
+    off_t len = lseek(fd, 0, SEEK_END);
+    char *data = malloc(len + 1);
+
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_EQUAL_INT(len, pread(fd, data, len, 0));
+    *size = len;
+    return data;
+}
+
+void test_exec_capture_large_output()
+{
+    struct exec_output out = { NULL, 0, 0 };
+    struct exec_output err = { NULL, 0, 0 };
+    size_t expected_size;
+    char *expected = expected_seq(&expected_size);
+
+    TEST_ASSERT_GREATER_THAN_MESSAGE(65536 * 2, expected_size, "The output should overflow a pipe");
+
+    // All of stdout is written before any of stderr, so both pipes must be drained together
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_capture(&out, &err, 3, "/bin/sh", "-c",
+            "seq 1 " SEQ_LINES "; seq 1 " SEQ_LINES " >&2"), "The command's output is captured");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(expected_size, out.size, "All of standard out is captured");
+    TEST_ASSERT_EQUAL_MEMORY(expected, out.data, expected_size);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(expected_size, err.size, "All of standard error is captured");
+    TEST_ASSERT_EQUAL_MEMORY(expected, err.data, expected_size);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, out.data[out.size], "The output is NUL terminated");
+
+    // Output is appended to what the buffers already hold
+    TEST_ASSERT_TRUE(do_exec_capture(&out, NULL, 2, "/bin/echo", "appended"));
+    TEST_ASSERT_EQUAL_UINT(expected_size + 9, out.size);
+    TEST_ASSERT_EQUAL_STRING("appended\n", out.data + expected_size);
+
+    free(out.data);
+    free(err.data);
+    out.data = NULL;
+    out.size = out.capacity = 0;
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_capture(&out, NULL, 3, "/bin/sh", "-c", "echo partial; exit 2"),
+            "A failed command's status is returned");
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("partial\n", out.data, "Output is captured even when the command fails");
+    free(out.data);
+    free(expected);
+}
+
+/**
+ * Runs seq into a temporary file opened with @param flags and checks the file holds its output
+ */
+static void check_splice(int flags)
+{
+    char path[] = "/tmp/aesd-splice-XXXXXX";
+    size_t expected_size;
+    char *expected = expected_seq(&expected_size);
+    size_t bytes = 0;
+    size_t size;
+    char *data;
+    int fd;
+
+    fd = mkstemp(path);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    unlink(path);
+    if (flags) {
+        TEST_ASSERT_NOT_EQUAL(-1, fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | flags));
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_splice(fd, &bytes, 4, "/usr/bin/env", "seq", "1", SEQ_LINES),
+            "The command's output is written to the file");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(expected_size, bytes, "bytes counts all of the output");
+    data = read_back(fd, &size);
+    TEST_ASSERT_EQUAL_UINT(expected_size, size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, data, expected_size);
+
+    free(data);
+    free(expected);
+    close(fd);
+}
+
+void test_exec_splice_to_file()
+{
+    check_splice(0);
+}
+
+void test_exec_splice_einval_fallback()
+{
+    // splice() refuses files opened with O_APPEND with EINVAL, so the output is copied instead
+    check_splice(O_APPEND);
+}
+
+void test_exec_splice_failed_command()
+{
+    char path[] = "/tmp/aesd-splice-XXXXXX";
+    size_t bytes = 1;
+    int fd;
+
+    fd = mkstemp(path);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    unlink(path);
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_splice(fd, &bytes, 1, "/bin/false"), "A failed command's status is returned");
+    TEST_ASSERT_EQUAL_UINT(0, bytes);
+    close(fd);
+}
@@ -0,0 +1,83 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+void test_exec_pipeline_output()
+{
+    struct exec_pipeline pipeline;
+    char path[] = "/tmp/aesd-pipeline-XXXXXX";
+    char data[32] = { 0 };
+    int fd;
+
+    fd = mkstemp(path);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+
+    exec_pipeline_init(&pipeline);
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 3, "/usr/bin/env", "seq", "100"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 3, "/usr/bin/env", "tail", "-n2"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 4, "/usr/bin/env", "tr", "\\n", ","));
+    exec_pipeline_redirect(&pipeline, path);
+    TEST_ASSERT_TRUE_MESSAGE(exec_pipeline_run(&pipeline), "Every stage of the pipeline succeeds");
+    TEST_ASSERT_EQUAL_INT(-1, exec_pipeline_failed_stage(&pipeline));
+    exec_pipeline_free(&pipeline);
+    TEST_ASSERT_EQUAL_INT(0, pipeline.count);
+
+    TEST_ASSERT_EQUAL_INT(7, pread(fd, data, sizeof(data) - 1, 0));
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("99,100,", data, "The last stage writes to the output file");
+    close(fd);
+    unlink(path);
+}
+
+void test_exec_pipeline_pipefail()
+{
+    struct exec_pipeline pipeline;
+
+    exec_pipeline_init(&pipeline);
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 1, "/bin/false"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 3, "/bin/sh", "-c", "cat; exit 4"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 1, "/bin/cat"));
+    TEST_ASSERT_FALSE(exec_pipeline_run(&pipeline));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, exec_pipeline_failed_stage(&pipeline),
+            "The last stage which failed is reported");
+    TEST_ASSERT_EQUAL_INT(1, WEXITSTATUS(pipeline.stage[0].status));
+    TEST_ASSERT_EQUAL_INT(4, WEXITSTATUS(pipeline.stage[1].status));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(pipeline.stage[2].status));
+    exec_pipeline_free(&pipeline);
+}
+
+void test_exec_pipeline_unspawnable_middle_stage()
+{
+    struct exec_pipeline pipeline;
+
+    // The first stage writes more than a pipe holds, so it only exits once its reader is gone
+    exec_pipeline_init(&pipeline);
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 3, "/usr/bin/env", "seq", "1000000"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 1, "/nonexistent/command"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 1, "/bin/cat"));
+    TEST_ASSERT_FALSE_MESSAGE(exec_pipeline_run(&pipeline), "A stage which can't start fails the pipeline");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, exec_pipeline_failed_stage(&pipeline),
+            "The stage which couldn't be started is reported");
+
+    TEST_ASSERT_NOT_EQUAL_MESSAGE(-1, pipeline.stage[0].pid, "The first stage was started");
+    TEST_ASSERT_TRUE_MESSAGE(WIFSIGNALED(pipeline.stage[0].status) &&
+            WTERMSIG(pipeline.stage[0].status) == SIGPIPE, "The first stage was reaped after SIGPIPE");
+    TEST_ASSERT_EQUAL_INT(-1, pipeline.stage[1].pid);
+    TEST_ASSERT_EQUAL_INT(-1, pipeline.stage[1].status);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, pipeline.stage[2].pid, "Stages after the failed one aren't started");
+    TEST_ASSERT_EQUAL_INT(-1, pipeline.stage[2].status);
+    exec_pipeline_free(&pipeline);
+
+    // The first stage failing to start is reported the same way
+    exec_pipeline_init(&pipeline);
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 1, "/nonexistent/command"));
+    TEST_ASSERT_TRUE(exec_pipeline_add(&pipeline, 1, "/bin/cat"));
+    TEST_ASSERT_FALSE(exec_pipeline_run(&pipeline));
+    TEST_ASSERT_EQUAL_INT(0, exec_pipeline_failed_stage(&pipeline));
+    exec_pipeline_free(&pipeline);
+}
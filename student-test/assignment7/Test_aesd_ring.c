@@ -0,0 +1,100 @@
+#include "unity.h"
+#include <stdbool.h>
+#include "../../aesd-char-driver/aesd-ring.h"
+
+// A power of 2 capacity, so the index arithmetic takes the mask path
+AESD_RING_DEFINE(test_ring, int, 8);
+
+// A capacity that isn't a power of 2, taking the modulo path
+AESD_RING_DEFINE(test_ring5, int, 5);
+
+void test_aesd_ring_push_pop()
+{
+    struct test_ring ring;
+    int value;
+    int i;
+
+    test_ring_init(&ring);
+    TEST_ASSERT_TRUE_MESSAGE(test_ring_empty(&ring), "A new ring is empty");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, test_ring_count(&ring), "A new ring has no elements");
+    TEST_ASSERT_NULL_MESSAGE(test_ring_at(&ring, 0), "at() past the newest element is NULL");
+    TEST_ASSERT_FALSE_MESSAGE(test_ring_pop(&ring, &value), "pop() on an empty ring fails");
+
+    for (i = 0; i < 8; i++) {
+        TEST_ASSERT_FALSE_MESSAGE(test_ring_push(&ring, &i, NULL), "No overwrite until the ring is full");
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(i + 1, test_ring_count(&ring), "count() follows each push");
+    }
+    TEST_ASSERT_TRUE_MESSAGE(ring.full, "Eight pushes fill a ring of 8");
+    TEST_ASSERT_FALSE_MESSAGE(test_ring_empty(&ring), "A full ring isn't empty");
+
+    for (i = 0; i < 8; i++) {
+        TEST_ASSERT_TRUE_MESSAGE(test_ring_pop(&ring, &value), "pop() succeeds while elements remain");
+        TEST_ASSERT_EQUAL_INT_MESSAGE(i, value, "Elements pop oldest first");
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(7 - i, test_ring_count(&ring), "count() follows each pop");
+    }
+    TEST_ASSERT_TRUE_MESSAGE(test_ring_empty(&ring), "The ring is empty after popping everything");
+}
+
+void test_aesd_ring_overwrite_and_wrap()
+{
+    struct test_ring ring;
+    int overwritten;
+    int value;
+    int i;
+
+    test_ring_init(&ring);
+    for (i = 0; i < 8; i++)
+        test_ring_push(&ring, &i, NULL);
+
+    // Each further push overwrites the oldest element and wraps in_offs and out_offs
+    for (i = 8; i < 21; i++) {
+        overwritten = -1;
+        TEST_ASSERT_TRUE_MESSAGE(test_ring_push(&ring, &i, &overwritten), "A push to a full ring overwrites");
+        TEST_ASSERT_EQUAL_INT_MESSAGE(i - 8, overwritten, "The oldest element is the one overwritten");
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(8, test_ring_count(&ring), "count() stays at the capacity");
+        TEST_ASSERT_LESS_THAN(8, ring.in_offs);
+        TEST_ASSERT_LESS_THAN(8, ring.out_offs);
+    }
+
+    for (i = 0; i < 8; i++)
+        TEST_ASSERT_EQUAL_INT_MESSAGE(13 + i, *test_ring_at(&ring, i), "at() walks oldest to newest");
+    TEST_ASSERT_NULL_MESSAGE(test_ring_at(&ring, 8), "at() past the newest element is NULL");
+
+    // Pop part way, then push again so the stored elements straddle the end of the array
+    for (i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(test_ring_pop(&ring, &value));
+        TEST_ASSERT_EQUAL_INT(13 + i, value);
+    }
+    TEST_ASSERT_FALSE_MESSAGE(ring.full, "pop() clears full");
+    for (i = 21; i < 24; i++)
+        TEST_ASSERT_FALSE_MESSAGE(test_ring_push(&ring, &i, NULL), "No overwrite with free slots");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(6, test_ring_count(&ring), "count() across the end of the array");
+    for (i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(test_ring_pop(&ring, &value));
+        TEST_ASSERT_EQUAL_INT_MESSAGE(18 + i, value, "Elements pop in order across the wrap");
+    }
+    TEST_ASSERT_TRUE(test_ring_empty(&ring));
+}
+
+void test_aesd_ring_non_power_of_2()
+{
+    struct test_ring5 ring;
+    int overwritten;
+    int value;
+    int i;
+
+    test_ring5_init(&ring);
+    for (i = 0; i < 12; i++) {
+        overwritten = -1;
+        TEST_ASSERT_EQUAL_INT_MESSAGE(i >= 5, test_ring5_push(&ring, &i, &overwritten),
+                "Pushes overwrite only once 5 elements are stored");
+        if (i >= 5)
+            TEST_ASSERT_EQUAL_INT(i - 5, overwritten);
+        TEST_ASSERT_EQUAL_UINT(i < 5 ? i + 1 : 5, test_ring5_count(&ring));
+    }
+    for (i = 7; i < 12; i++) {
+        TEST_ASSERT_TRUE(test_ring5_pop(&ring, &value));
+        TEST_ASSERT_EQUAL_INT(i, value);
+    }
+    TEST_ASSERT_TRUE(test_ring5_empty(&ring));
+}
@@ -0,0 +1,152 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../../aesd-char-driver/aesd-circular-buffer.h"
+
+static const char *commands[] = {
+    "write1\n", "write2\n", "write3\n", "write4\n", "write5\n", "write6\n",
+    "write7\n", "write8\n", "write9\n", "write10\n", "write11\n", "write12\n",
+};
+
+/**
+ * Adds commands[first] up to but not including commands[last] to @param buffer
+ */
+static void add_commands(struct aesd_circular_buffer *buffer, unsigned int first, unsigned int last)
+{
+    struct aesd_buffer_entry entry;
+    unsigned int i;
+
+    for (i = first; i < last; i++) {
+        entry.buffptr = commands[i];
+        entry.size = strlen(commands[i]);
+        aesd_circular_buffer_add_entry(buffer, &entry);
+    }
+}
+
+void test_circular_buffer_add_entry_evict()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry entry;
+    struct aesd_buffer_entry evicted;
+    size_t total_size;
+
+    aesd_circular_buffer_init(&buffer);
+    add_commands(&buffer, 0, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - 1);
+
+    entry.buffptr = commands[9];
+    entry.size = strlen(commands[9]);
+    memset(&evicted, 0, sizeof(evicted));
+    TEST_ASSERT_FALSE_MESSAGE(aesd_circular_buffer_add_entry_evict(&buffer, &entry, &evicted),
+            "Nothing is evicted while the buffer has a free entry");
+    TEST_ASSERT_NULL_MESSAGE(evicted.buffptr, "evicted_entry is left alone when nothing is evicted");
+    TEST_ASSERT_TRUE(buffer.full);
+    total_size = buffer.total_size;
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(9 * 7 + 8, total_size, "total_size covers all ten commands");
+
+    entry.buffptr = commands[10];
+    entry.size = strlen(commands[10]);
+    TEST_ASSERT_TRUE_MESSAGE(aesd_circular_buffer_add_entry_evict(&buffer, &entry, &evicted),
+            "Adding to a full buffer evicts");
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(commands[0], evicted.buffptr, "The oldest command is evicted");
+    TEST_ASSERT_EQUAL_UINT(strlen(commands[0]), evicted.size);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(total_size + strlen(commands[10]) - strlen(commands[0]),
+            buffer.total_size, "total_size gains the new command and loses the evicted one");
+    TEST_ASSERT_EQUAL_UINT(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, aesd_circular_buffer_count(&buffer));
+
+    entry.buffptr = commands[11];
+    entry.size = strlen(commands[11]);
+    TEST_ASSERT_TRUE_MESSAGE(aesd_circular_buffer_add_entry_evict(&buffer, &entry, NULL),
+            "evicted_entry may be NULL");
+}
+
+void test_circular_buffer_foreach_logical()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry *entry;
+    uint8_t index;
+
+    aesd_circular_buffer_init(&buffer);
+    AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry, &buffer, index) {
+        TEST_FAIL_MESSAGE("An empty buffer has no entries to visit");
+    }
+
+    add_commands(&buffer, 0, 3);
+    AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry, &buffer, index) {
+        TEST_ASSERT_EQUAL_PTR_MESSAGE(commands[index], entry->buffptr,
+                "A partly filled buffer is visited oldest first");
+    }
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(3, index, "Only the stored entries are visited");
+
+    // Twelve commands in ten entries, so the oldest stored is in the middle of the array
+    add_commands(&buffer, 3, 12);
+    AESD_CIRCULAR_BUFFER_FOREACH_LOGICAL(entry, &buffer, index) {
+        TEST_ASSERT_EQUAL_PTR_MESSAGE(commands[index + 2], entry->buffptr,
+                "A wrapped buffer is visited oldest first");
+    }
+    TEST_ASSERT_EQUAL_UINT(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, index);
+}
+
+void test_circular_buffer_export_iovec()
+{
+    struct aesd_circular_buffer buffer;
+    aesd_iovec_t vec[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    size_t entry_offset = 99;
+    unsigned int nr_vecs;
+
+    aesd_circular_buffer_init(&buffer);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, aesd_circular_buffer_export_iovec(&buffer, 0, 0, vec,
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &entry_offset), "An empty buffer exports nothing");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(99, entry_offset, "entry_offset_byte_rtn is only set with data");
+
+    // Stored: write3\n write4\n ... write9\n write10\n write11\n write12\n, 73 bytes
+    add_commands(&buffer, 0, 12);
+
+    nr_vecs = aesd_circular_buffer_export_iovec(&buffer, 0, 0, vec,
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &entry_offset);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, nr_vecs,
+            "With no limit every entry is exported");
+    TEST_ASSERT_EQUAL_UINT(0, entry_offset);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(commands[2], vec[0].iov_base, "The oldest entry comes first");
+    TEST_ASSERT_EQUAL_PTR(commands[11], vec[9].iov_base);
+    TEST_ASSERT_EQUAL_UINT(strlen(commands[11]), vec[9].iov_len);
+
+    // Offset 10 is byte 3 of write4\n, the second stored entry
+    nr_vecs = aesd_circular_buffer_export_iovec(&buffer, 10, 0, vec,
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, &entry_offset);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(9, nr_vecs, "Entries before the offset are skipped");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(3, entry_offset, "The first element starts part way into its entry");
+    TEST_ASSERT_EQUAL_PTR(commands[3] + 3, vec[0].iov_base);
+    TEST_ASSERT_EQUAL_UINT(4, vec[0].iov_len);
+    TEST_ASSERT_EQUAL_PTR(commands[4], vec[1].iov_base);
+
+    // max_bytes shortens the last element
+    nr_vecs = aesd_circular_buffer_export_iovec(&buffer, 10, 4 + 7 + 2, vec,
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, NULL);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(3, nr_vecs, "max_bytes stops the export");
+    TEST_ASSERT_EQUAL_UINT(4, vec[0].iov_len);
+    TEST_ASSERT_EQUAL_UINT(7, vec[1].iov_len);
+    TEST_ASSERT_EQUAL_PTR(commands[5], vec[2].iov_base);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(2, vec[2].iov_len, "The last element is shortened to fit max_bytes");
+
+    // max_bytes ending exactly on an entry boundary
+    nr_vecs = aesd_circular_buffer_export_iovec(&buffer, 0, 14, vec,
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, NULL);
+    TEST_ASSERT_EQUAL_UINT(2, nr_vecs);
+    TEST_ASSERT_EQUAL_UINT(7, vec[1].iov_len);
+
+    // max_vecs stops the export however many bytes remain
+    nr_vecs = aesd_circular_buffer_export_iovec(&buffer, 0, 0, vec, 4, NULL);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(4, nr_vecs, "max_vecs stops the export");
+    TEST_ASSERT_EQUAL_PTR(commands[5], vec[3].iov_base);
+
+    // Offsets at or past the end of the data
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, aesd_circular_buffer_export_iovec(&buffer, buffer.total_size, 0,
+            vec, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, NULL), "Nothing follows the last byte");
+    TEST_ASSERT_EQUAL_UINT(0, aesd_circular_buffer_export_iovec(&buffer, buffer.total_size + 100, 0,
+            vec, AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, NULL));
+    nr_vecs = aesd_circular_buffer_export_iovec(&buffer, buffer.total_size - 1, 0, vec,
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, NULL);
+    TEST_ASSERT_EQUAL_UINT(1, nr_vecs);
+    TEST_ASSERT_EQUAL_UINT(1, vec[0].iov_len);
+    TEST_ASSERT_EQUAL_MEMORY("\n", vec[0].iov_base, 1);
+}
@@ -0,0 +1,128 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../../aesd-char-driver/aesd-circular-buffer.h"
+
+/**
+ * Adds an entry of @param size bytes the way the aesdchar driver does, removing the oldest
+ * entries while aesd_circular_buffer_needs_eviction() asks for it.
+ * @return the number of entries removed
+ */
+static unsigned int add_with_retention(struct aesd_circular_buffer *buffer, const char *data, size_t size)
+{
+    struct aesd_buffer_entry entry = { .buffptr = data, .size = size };
+    struct aesd_buffer_entry removed;
+    unsigned int removed_count = 0;
+
+    while (aesd_circular_buffer_needs_eviction(buffer, size)) {
+        TEST_ASSERT_TRUE_MESSAGE(aesd_circular_buffer_remove_oldest(buffer, &removed),
+                "needs_eviction() asked for a removal from an empty buffer");
+        removed_count++;
+    }
+    aesd_circular_buffer_add_entry(buffer, &entry);
+    return removed_count;
+}
+
+void test_circular_buffer_byte_budget()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry *entry;
+
+    aesd_circular_buffer_init(&buffer);
+    buffer.max_bytes = 10;
+
+    TEST_ASSERT_FALSE_MESSAGE(aesd_circular_buffer_needs_eviction(&buffer, 100),
+            "An empty buffer never needs an eviction");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, add_with_retention(&buffer, "abcd\n", 5), "First entry fits");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, add_with_retention(&buffer, "efgh\n", 5),
+            "Second entry exactly fills the budget");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(10, buffer.total_size, "Both entries are counted");
+
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(1, add_with_retention(&buffer, "ij\n", 3),
+            "One entry must go to fit 3 more bytes in a 10 byte budget");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(8, buffer.total_size, "total_size drops by the removed entry");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(2, aesd_circular_buffer_count(&buffer), "Two entries remain");
+    entry = aesd_entry_ring_at(&buffer, 0);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("efgh\n", entry->buffptr, "The oldest entry was the one removed");
+}
+
+void test_circular_buffer_oversized_entry_kept()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry *entry;
+    static const char oversized[] = "this entry alone is larger than the budget\n";
+
+    aesd_circular_buffer_init(&buffer);
+    buffer.max_bytes = 8;
+
+    add_with_retention(&buffer, "abc\n", 4);
+    add_with_retention(&buffer, "def\n", 4);
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(2, add_with_retention(&buffer, oversized, sizeof(oversized) - 1),
+            "Every older entry is removed for an entry larger than max_bytes");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(1, aesd_circular_buffer_count(&buffer),
+            "The oversized entry is still stored");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(sizeof(oversized) - 1, buffer.total_size,
+            "total_size is the oversized entry alone");
+    entry = aesd_entry_ring_at(&buffer, 0);
+    TEST_ASSERT_EQUAL_PTR_MESSAGE(oversized, entry->buffptr, "The stored entry is the oversized one");
+
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(1, add_with_retention(&buffer, "ghi\n", 4),
+            "The oversized entry goes when the next entry arrives");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(4, buffer.total_size, "Only the new entry remains");
+}
+
+void test_circular_buffer_max_entries_cap()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry *entry;
+    static const char *data[] = { "0\n", "1\n", "2\n", "3\n", "4\n", "5\n" };
+    unsigned int i;
+
+    aesd_circular_buffer_init(&buffer);
+    buffer.max_entries = 3;
+
+    for (i = 0; i < 3; i++)
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(0, add_with_retention(&buffer, data[i], 2),
+                "No removal below max_entries");
+    for (; i < 6; i++) {
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(1, add_with_retention(&buffer, data[i], 2),
+                "One removal per entry once max_entries are stored");
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(3, aesd_circular_buffer_count(&buffer),
+                "The count stays at max_entries");
+    }
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(6, buffer.total_size, "total_size covers the three newest entries");
+    entry = aesd_entry_ring_at(&buffer, 0);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("3\n", entry->buffptr, "The oldest kept entry is the fourth added");
+}
+
+void test_circular_buffer_total_size_after_wrap()
+{
+    struct aesd_circular_buffer buffer;
+    struct aesd_buffer_entry removed;
+    static const char data[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    size_t expected = 0;
+    unsigned int i;
+
+    aesd_circular_buffer_init(&buffer);
+
+    // Entries of 1 to 25 bytes, wrapping the ring more than twice with no retention limits
+    for (i = 1; i <= 25; i++) {
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(0, add_with_retention(&buffer, data, i),
+                "Without max_bytes or max_entries only a full ring overwrites");
+        expected += i;
+        if (i > AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+            expected -= i - AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(expected, buffer.total_size,
+                "total_size matches the stored entries after each add");
+    }
+    TEST_ASSERT_TRUE_MESSAGE(buffer.full, "The ring is full after wrapping");
+
+    while (aesd_circular_buffer_remove_oldest(&buffer, &removed)) {
+        expected -= removed.size;
+        TEST_ASSERT_EQUAL_UINT_MESSAGE(expected, buffer.total_size,
+                "total_size drops by each removed entry");
+    }
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, buffer.total_size, "An emptied buffer holds no bytes");
+    TEST_ASSERT_EQUAL_UINT_MESSAGE(0, aesd_circular_buffer_count(&buffer), "An emptied buffer has no entries");
+    TEST_ASSERT_FALSE_MESSAGE(buffer.full, "An emptied buffer is not full");
+}